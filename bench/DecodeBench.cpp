@@ -0,0 +1,313 @@
+/// Offline decoding benchmark. Replays a directory of clips through SphinxDecoder as fast as it will go, once per search mode,
+/// and reports the real time factor, per utterance latency, peak resident memory and word error rate of each.
+/// Before that it brings up -decoders decoders one after another, the way the service fills its pool, and reports the resident
+/// memory each one added.
+/// Every clip.wav or clip.raw (mono samples at the decoder's rate) needs its reference transcript next to it in clip.txt.
+/// The JSGF modes are only run when a grammar is given, JSGF string mode decodes with the text of the same grammar file.
+/// Usage: pyramid-bench <clip directory> [-lm path] [-jsgf path] [-hmm path] [-dict path] [-samprate rate] [-decoders N]
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <cctype>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <dirent.h>
+
+#include "SphinxDecoder.h"
+#include "AudioFile.h"
+#include "AudioRingBuffer.h"
+#include "ResidentMemory.h"
+
+#define DEFAULT_MEMORY_DECODERS 3 // Same as the decoder-count the service ships with
+
+struct Clip {
+    std::string path;
+    std::string name;
+    std::vector<std::string> reference;
+};
+
+struct ModeResult {
+    double audioTime;
+    double decodeTime;
+    std::vector<double> latencies; // Milliseconds from the last block being decoded to the hypothesis
+    unsigned int wordErrors;
+    unsigned int referenceWords;
+    long peakResident;
+};
+
+static std::vector<std::string> splitWords(std::string text) {
+    std::vector<std::string> words;
+    std::istringstream in(text);
+    std::string w;
+    while(in >> w) {
+        std::transform(w.begin(), w.end(), w.begin(), [](unsigned char c) { return tolower(c); });
+        words.push_back(w);
+    }
+    return words;
+}
+
+/// Substitutions, insertions and deletions needed to turn the hypothesis into the reference
+static unsigned int editDistance(const std::vector<std::string> & reference, const std::vector<std::string> & hypothesis) {
+    std::vector<unsigned int> previous(hypothesis.size() + 1), current(hypothesis.size() + 1);
+    for(size_t j = 0; j <= hypothesis.size(); j++) {
+        previous[j] = j;
+    }
+    for(size_t i = 1; i <= reference.size(); i++) {
+        current[0] = i;
+        for(size_t j = 1; j <= hypothesis.size(); j++) {
+            unsigned int substitution = previous[j - 1] + (reference[i - 1] == hypothesis[j - 1] ? 0 : 1);
+            current[j] = std::min(substitution, std::min(previous[j], current[j - 1]) + 1);
+        }
+        std::swap(previous, current);
+    }
+    return previous[hypothesis.size()];
+}
+
+static std::vector<Clip> findClips(std::string directory) {
+    std::vector<Clip> clips;
+    DIR * dir = opendir(directory.c_str());
+    if(dir == NULL) {
+        std::cerr << "Unable to open " << directory << ": " << strerror(errno) << std::endl;
+        return clips;
+    }
+    struct dirent * entry;
+    while((entry = readdir(dir)) != NULL) {
+        std::string file = entry->d_name;
+        size_t dot = file.rfind('.');
+        if(dot == std::string::npos || (file.compare(dot, 4, ".wav") != 0 && file.compare(dot, 4, ".raw") != 0)) {
+            continue;
+        }
+        Clip c;
+        c.name = file.substr(0, dot);
+        c.path = directory + "/" + file;
+        std::ifstream transcript(directory + "/" + c.name + ".txt");
+        if(!transcript) {
+            std::cerr << "Skipping " << file << ", it has no " << c.name << ".txt transcript" << std::endl;
+            continue;
+        }
+        std::stringstream text;
+        text << transcript.rdbuf();
+        c.reference = splitWords(text.str());
+        clips.push_back(c);
+    }
+    closedir(dir);
+    std::sort(clips.begin(), clips.end(), [](const Clip & a, const Clip & b) { return a.name < b.name; });
+    return clips;
+}
+
+/// Forgets the peak resident set size so the next mode is measured on its own. Only resets on Linux 4.0 and later, otherwise peaks accumulate.
+static void resetPeakResident() {
+    std::ofstream clear("/proc/self/clear_refs");
+    clear << "5";
+}
+
+static long getPeakResident() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while(std::getline(status, line)) {
+        if(line.compare(0, 6, "VmHWM:") == 0) {
+            return atol(line.c_str() + 6);
+        }
+    }
+    return -1;
+}
+
+/// Creates count decoders one at a time, so each one's growth of the resident set is its own, and frees them again
+static void measureDecoderMemory(unsigned int count, std::string hmmPath, std::string dictPath, int sampleRate) {
+    std::cout << "== decoder memory ==" << std::endl;
+    std::vector<SphinxDecoder *> decoders;
+    long first = 0, rest = 0;
+    long before = getResidentMemory();
+    for(unsigned int i = 0; i < count; i++) {
+        SphinxDecoder * sd = new SphinxDecoder("bench-" + std::to_string(i), hmmPath, dictPath, DEFAULT_LOG_PATH, sampleRate);
+        sd->startUtterance(); // Warm like a pool decoder waiting for audio
+        decoders.push_back(sd);
+        long after = getResidentMemory();
+        std::cout << "decoder " << i << "  +" << after - before << " kB  rss " << after << " kB" << std::endl;
+        if(i == 0) {
+            first = after - before;
+        }
+        else {
+            rest += after - before;
+        }
+        before = after;
+    }
+    //Whatever a decoder shares with the others only shows up in the first one, so the average of the rest is what each extra decoder costs
+    if(count > 1) {
+        std::cout << "first decoder " << first << " kB, each additional decoder " << rest / (long) (count - 1) << " kB" << std::endl;
+    }
+    for(SphinxDecoder * sd : decoders) {
+        delete sd;
+    }
+}
+
+static bool runMode(std::string label, SphinxDecoder & sd, const std::vector<Clip> & clips, int sampleRate, ModeResult & result) {
+    result = ModeResult{0, 0, {}, 0, 0, 0};
+    std::vector<int16> samples(AUDIO_FRAME_SIZE);
+    std::cout << "== " << label << " ==" << std::endl;
+    for(const Clip & c : clips) {
+        AudioFile file(sampleRate);
+        if(!file.open(c.path)) {
+            std::cerr << "Skipping " << c.path << ": " << file.getError() << std::endl;
+            continue;
+        }
+        sd.startUtterance();
+        if(sd.getState() != SphinxHelper::DecoderState::UTTERANCE_STARTED) {
+            std::cerr << "Unable to start an utterance in " << label << " mode" << std::endl;
+            return false;
+        }
+
+        //Blocks go in the same size the capture thread hands them over, without any pacing
+        auto start = std::chrono::steady_clock::now();
+        int32 n;
+        while((n = file.read(samples.data(), AUDIO_FRAME_SIZE)) > 0) {
+            sd.processRawAudio(samples.data(), n);
+        }
+        auto fed = std::chrono::steady_clock::now();
+        sd.endUtterance();
+        std::string hyp = sd.getHypothesis();
+        auto done = std::chrono::steady_clock::now();
+
+        double audioTime = file.getDuration();
+        double decodeTime = std::chrono::duration<double>(done - start).count();
+        double latency = std::chrono::duration<double, std::milli>(done - fed).count();
+        unsigned int errors = editDistance(c.reference, splitWords(hyp));
+        result.audioTime += audioTime;
+        result.decodeTime += decodeTime;
+        result.latencies.push_back(latency);
+        result.wordErrors += errors;
+        result.referenceWords += c.reference.size();
+
+        std::cout << std::left << std::setw(24) << c.name << std::right << std::fixed
+                  << std::setprecision(2) << std::setw(8) << audioTime << " s  rtf " << std::setprecision(3) << decodeTime / audioTime
+                  << "  latency " << std::setprecision(1) << std::setw(7) << latency << " ms  errors " << errors << "/" << c.reference.size()
+                  << "  \"" << hyp << "\"" << std::endl;
+    }
+    result.peakResident = getPeakResident();
+    return true;
+}
+
+static void printSummary(std::string label, ModeResult & r) {
+    if(r.latencies.empty()) {
+        std::cout << std::left << std::setw(12) << label << "no clips decoded" << std::endl;
+        return;
+    }
+    std::sort(r.latencies.begin(), r.latencies.end());
+    double total = 0;
+    for(double l : r.latencies) {
+        total += l;
+    }
+    std::cout << std::left << std::setw(12) << label << std::right << std::fixed
+              << std::setw(5) << r.latencies.size() << " clips "
+              << std::setprecision(1) << std::setw(8) << r.audioTime << " s  rtf " << std::setprecision(3) << r.decodeTime / r.audioTime
+              << "  latency avg " << std::setprecision(1) << total / r.latencies.size()
+              << " p50 " << r.latencies[r.latencies.size() / 2]
+              << " max " << r.latencies.back() << " ms"
+              << "  peak rss " << r.peakResident << " kB"
+              << "  wer " << std::setprecision(2) << (r.referenceWords == 0 ? 0.0 : 100.0 * r.wordErrors / r.referenceWords) << "%" << std::endl;
+}
+
+int main(int argc, char * argv[]) {
+    std::string directory, lmPath = DEFAULT_LM_PATH, jsgfPath, hmmPath = DEFAULT_HMM_PATH, dictPath = DEFAULT_DICT_PATH;
+    int sampleRate = DEFAULT_SAMPLE_RATE;
+    int memoryDecoders = DEFAULT_MEMORY_DECODERS;
+    for(int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if(arg[0] != '-') {
+            directory = arg;
+        }
+        else if(i + 1 < argc && arg == "-lm") {
+            lmPath = argv[++i];
+        }
+        else if(i + 1 < argc && arg == "-jsgf") {
+            jsgfPath = argv[++i];
+        }
+        else if(i + 1 < argc && arg == "-hmm") {
+            hmmPath = argv[++i];
+        }
+        else if(i + 1 < argc && arg == "-dict") {
+            dictPath = argv[++i];
+        }
+        else if(i + 1 < argc && arg == "-samprate") {
+            sampleRate = atoi(argv[++i]);
+        }
+        else if(i + 1 < argc && arg == "-decoders") {
+            memoryDecoders = atoi(argv[++i]);
+        }
+        else {
+            directory.clear();
+            break;
+        }
+    }
+    if(directory.empty() || sampleRate <= 0 || memoryDecoders < 0) {
+        std::cerr << "Usage: " << argv[0] << " <clip directory> [-lm path] [-jsgf path] [-hmm path] [-dict path] [-samprate rate] [-decoders N]" << std::endl;
+        return 1;
+    }
+
+    std::vector<Clip> clips = findClips(directory);
+    if(clips.empty()) {
+        std::cerr << "No clips with transcripts found in " << directory << std::endl;
+        return 1;
+    }
+
+    std::string jsgf;
+    if(!jsgfPath.empty()) {
+        std::ifstream in(jsgfPath);
+        if(!in) {
+            std::cerr << "Unable to read " << jsgfPath << std::endl;
+            return 1;
+        }
+        std::stringstream text;
+        text << in.rdbuf();
+        jsgf = text.str();
+    }
+
+    struct Mode {
+        std::string label;
+        SphinxHelper::SearchMode mode;
+    };
+    std::vector<Mode> modes = {{"lm", SphinxHelper::SearchMode::LM}};
+    if(!jsgf.empty()) {
+        modes.push_back({"jsgf-string", SphinxHelper::SearchMode::JSGF_STRING});
+        modes.push_back({"jsgf-file", SphinxHelper::SearchMode::JSGF_FILE});
+    }
+
+    measureDecoderMemory(memoryDecoders, hmmPath, dictPath, sampleRate);
+
+    std::vector<ModeResult> results(modes.size());
+    for(size_t i = 0; i < modes.size(); i++) {
+        //A fresh decoder for each mode so one mode's searches do not count against the next one's memory
+        resetPeakResident();
+        SphinxDecoder sd("bench", hmmPath, dictPath, DEFAULT_LOG_PATH, sampleRate);
+        if(sd.getState() == SphinxHelper::DecoderState::ERROR) {
+            std::cerr << "Unable to create a decoder" << std::endl;
+            return 1;
+        }
+        if(modes[i].mode == SphinxHelper::SearchMode::LM) {
+            sd.updateLM(lmPath, true);
+        }
+        else if(modes[i].mode == SphinxHelper::SearchMode::JSGF_STRING) {
+            sd.updateJSGFString(jsgf, true);
+        }
+        else {
+            sd.updateJSGFFile(jsgfPath, true);
+        }
+        sd.selectSearchMode(modes[i].mode, true);
+        if(!runMode(modes[i].label, sd, clips, sampleRate, results[i])) {
+            return 1;
+        }
+    }
+
+    std::cout << "== summary ==" << std::endl;
+    for(size_t i = 0; i < modes.size(); i++) {
+        printSummary(modes[i].label, results[i]);
+    }
+    return 0;
+}
@@ -0,0 +1,398 @@
+/// Reconfiguration latency benchmark. Times every SphinxDecoder update as it is applied to a warm decoder, for grammars from
+/// confirm.gram up to 10000 rules, and with -service also the whole setGrammar/setRecognitionMode/applyUpdates round trip
+/// through PyramidASRService, first while idle and then while listening. Grammar and language model updates are timed both with
+/// a search the decoder has not built yet (cold) and with the same one again (cached). Results are written to stdout as JSON.
+/// The service is configured from pyramid.conf in the running directory, -config changes to another directory first.
+/// Usage: pyramid-reconfigure-bench [-runs N] [-grammar path] [-lm path] [-hmm path] [-dict path] [-service] [-config directory]
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#include "SphinxDecoder.h"
+#include "CompiledGrammar.h"
+#include "PyramidASRService.h"
+
+#define GRAMMAR_WORDS_PER_RULE 3
+#define LISTEN_TIMEOUT 5 // Seconds to wait for the audio device to start before skipping the listening runs
+#define APPLY_TIMEOUT 120 // Seconds to wait for UpdatesApplied before giving up on a run
+
+struct Measurement {
+    std::string operation;
+    std::string grammar; // Empty for updates that do not involve a grammar
+    unsigned int rules; // Rule definitions in the grammar, the public rule included
+    std::string state; // What the decoder or service was doing when the update was made
+    std::vector<double> ms;
+};
+
+struct Grammar {
+    std::string name;
+    unsigned int rules; // Rule definitions, the public rule included
+    std::string text; // Contains GRAMMAR_NAME_MARKER where the grammar name goes, so every run can get a different grammar
+};
+
+#define GRAMMAR_NAME_MARKER "@NAME@"
+
+//Common words in the CMU dictionary, combined into unique phrases to build grammars of any size
+static const char * vocabulary[] = {
+    "turn", "on", "off", "the", "light", "kitchen", "bedroom", "living", "room", "bathroom", "garage", "door",
+    "window", "open", "close", "lock", "unlock", "play", "pause", "stop", "music", "volume", "up", "down",
+    "next", "previous", "set", "timer", "alarm", "for", "minutes", "hours", "call", "mom", "dad", "weather",
+    "today", "tomorrow", "what", "is", "time", "show", "me", "read", "news", "start", "cancel", "please"
+};
+#define VOCABULARY_SIZE (sizeof(vocabulary) / sizeof(vocabulary[0]))
+
+static Grammar generateGrammar(unsigned int rules) {
+    std::ostringstream g;
+    g << "#JSGF V1.0;\ngrammar " << GRAMMAR_NAME_MARKER << ";\npublic <command> = ";
+    for(unsigned int i = 0; i < rules; i++) {
+        g << ((i == 0) ? "" : " | ") << "<r" << i << ">";
+    }
+    g << ";\n";
+    for(unsigned int i = 0; i < rules; i++) {
+        g << "<r" << i << "> =";
+        unsigned int n = i;
+        for(unsigned int w = 0; w < GRAMMAR_WORDS_PER_RULE; w++) {
+            g << " " << vocabulary[n % VOCABULARY_SIZE];
+            n /= VOCABULARY_SIZE;
+        }
+        g << ";\n";
+    }
+    return {"generated-" + std::to_string(rules), rules + 1, g.str()};
+}
+
+/// Counts the rule definitions in JSGF text, the public ones included. Only meant for the simple grammars used here, it does not skip comments.
+static unsigned int countRules(const std::string & text) {
+    unsigned int rules = 0;
+    size_t pos = 0;
+    while((pos = text.find('<', pos)) != std::string::npos) {
+        size_t close = text.find('>', pos);
+        if(close == std::string::npos) {
+            break;
+        }
+        size_t next = text.find_first_not_of(" \t\r\n", close + 1);
+        //A rule name followed by = is a definition, anywhere else it is a reference to the rule
+        if(next != std::string::npos && text[next] == '=') {
+            rules++;
+        }
+        pos = close + 1;
+    }
+    return rules;
+}
+
+/// Gives the grammar a name of its own, so the decoder sees different JSGF text and can not serve it from its search cache
+static std::string nameGrammar(const Grammar & g, std::string name) {
+    std::string text = g.text;
+    size_t marker = text.find(GRAMMAR_NAME_MARKER);
+    if(marker != std::string::npos) {
+        text.replace(marker, strlen(GRAMMAR_NAME_MARKER), name);
+    }
+    return text;
+}
+
+static std::string writeGrammarFile(std::string text, std::string name) {
+    std::string path = "/tmp/pyramid-bench-" + std::to_string(getpid()) + "-" + name + ".gram";
+    std::ofstream out(path);
+    out << text;
+    return path;
+}
+
+static double timeMs(std::function<void()> f) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+/// Updates are made to a decoder with an utterance started, the way every warm decoder in the pool sits
+static Measurement timeUpdate(SphinxDecoder & sd, std::string operation, const Grammar * g, unsigned int runs, std::function<void(unsigned int)> update) {
+    Measurement m{operation, (g == nullptr) ? "" : g->name, (g == nullptr) ? 0 : g->rules, "warm", {}};
+    for(unsigned int i = 0; i < runs; i++) {
+        sd.startUtterance();
+        m.ms.push_back(timeMs([&] { update(i); }));
+    }
+    sd.startUtterance();
+    return m;
+}
+
+static void benchDecoder(std::vector<Measurement> & results, std::vector<Grammar> & grammars, unsigned int runs, std::string lmPath, std::string hmmPath, std::string dictPath) {
+    SphinxDecoder sd("bench", hmmPath, dictPath, DEFAULT_LOG_PATH, DEFAULT_SAMPLE_RATE);
+    if(sd.getState() == SphinxHelper::DecoderState::ERROR) {
+        std::cerr << "Unable to create a decoder" << std::endl;
+        return;
+    }
+    //Grammar strings are switched with the JSGF string search active so each update includes making the new search current
+    sd.updateLM(lmPath, true);
+    sd.updateJSGFString(nameGrammar(grammars.front(), "initial"), true);
+    sd.selectSearchMode(SphinxHelper::SearchMode::JSGF_STRING, true);
+
+    for(Grammar & g : grammars) {
+        std::cerr << "Timing decoder updates with " << g.name << std::endl;
+        results.push_back(timeUpdate(sd, "compileGrammar", &g, runs, [&](unsigned int i) {
+            CompiledGrammar::compileString(nameGrammar(g, "compile" + std::to_string(i)), sd.getLogBase(), sd.getLanguageWeight()).get();
+        }));
+        results.push_back(timeUpdate(sd, "_updateJSGFString cold", &g, runs, [&](unsigned int i) {
+            sd.updateJSGFString(nameGrammar(g, "string" + std::to_string(i)), true);
+        }));
+        std::string cached = nameGrammar(g, "cached");
+        sd.updateJSGFString(cached, true);
+        results.push_back(timeUpdate(sd, "_updateJSGFString cached", &g, runs, [&](unsigned int) {
+            sd.updateJSGFString(cached, true);
+        }));
+
+        //The grammar compiled ahead of time the way setGrammar does it, only installing it is left to the decoder
+        std::vector<PendingGrammar> compiled;
+        std::vector<std::string> texts;
+        for(unsigned int i = 0; i < runs; i++) {
+            texts.push_back(nameGrammar(g, "shared" + std::to_string(i)));
+            compiled.push_back(CompiledGrammar::compileString(texts.back(), sd.getLogBase(), sd.getLanguageWeight()));
+            compiled.back().wait();
+        }
+        results.push_back(timeUpdate(sd, "_updateJSGFString precompiled", &g, runs, [&](unsigned int i) {
+            sd.updateJSGFString(texts[i], compiled[i], true);
+        }));
+
+        //The file search is not the active one, so these only time loading and compiling the grammar
+        std::vector<std::string> paths;
+        for(unsigned int i = 0; i < runs; i++) {
+            paths.push_back(writeGrammarFile(nameGrammar(g, "file" + std::to_string(i)), g.name + "-" + std::to_string(i)));
+        }
+        results.push_back(timeUpdate(sd, "_updateJSGFFile cold", &g, runs, [&](unsigned int i) {
+            sd.updateJSGFFile(paths[i], true);
+        }));
+        results.push_back(timeUpdate(sd, "_updateJSGFFile cached", &g, runs, [&](unsigned int) {
+            sd.updateJSGFFile(paths[0], true);
+        }));
+        for(std::string & p : paths) {
+            unlink(p.c_str());
+        }
+
+        results.push_back(timeUpdate(sd, "_selectSearchMode", &g, runs, [&](unsigned int i) {
+            sd.selectSearchMode((i % 2 == 0) ? SphinxHelper::SearchMode::LM : SphinxHelper::SearchMode::JSGF_STRING, true);
+        }));
+        sd.selectSearchMode(SphinxHelper::SearchMode::JSGF_STRING, true);
+    }
+
+    //The dictionary and acoustic model reload the whole decoder, so they go last
+    std::cerr << "Timing the other decoder updates" << std::endl;
+    sd.selectSearchMode(SphinxHelper::SearchMode::LM, true);
+    //The search cache is keyed on the path, so a link of its own per run makes the decoder load the model again
+    char * target = realpath(lmPath.c_str(), NULL);
+    std::vector<std::string> lmLinks;
+    for(unsigned int i = 0; target != NULL && i < runs; i++) {
+        lmLinks.push_back("/tmp/pyramid-bench-" + std::to_string(getpid()) + "-lm-" + std::to_string(i));
+        if(symlink(target, lmLinks.back().c_str()) != 0) {
+            lmLinks.pop_back();
+            break;
+        }
+    }
+    free(target);
+    if(lmLinks.size() == runs) {
+        results.push_back(timeUpdate(sd, "_updateLM cold", nullptr, runs, [&](unsigned int i) {
+            sd.updateLM(lmLinks[i], true);
+        }));
+    }
+    else {
+        std::cerr << "Unable to link " << lmPath << " under /tmp, skipping the cold language model runs" << std::endl;
+    }
+    for(std::string & l : lmLinks) {
+        unlink(l.c_str());
+    }
+    sd.updateLM(lmPath, true);
+    results.push_back(timeUpdate(sd, "_updateLM cached", nullptr, runs, [&](unsigned int) {
+        sd.updateLM(lmPath, true);
+    }));
+    results.push_back(timeUpdate(sd, "_updateKeyword", nullptr, runs, [&](unsigned int i) {
+        sd.updateKeyword(std::string(vocabulary[i % VOCABULARY_SIZE]) + " " + vocabulary[(i + 1) % VOCABULARY_SIZE], DEFAULT_KEYWORD_THRESHOLD, true);
+    }));
+    results.push_back(timeUpdate(sd, "_updateLoggingFile", nullptr, runs, [&](unsigned int) {
+        sd.updateLoggingFile(DEFAULT_LOG_PATH, true);
+    }));
+    results.push_back(timeUpdate(sd, "_updateDictionary", nullptr, runs, [&](unsigned int) {
+        sd.updateDictionary(dictPath, true);
+    }));
+    results.push_back(timeUpdate(sd, "_updateAcousticModel", nullptr, runs, [&](unsigned int) {
+        sd.updateAcousticModel(hmmPath, true);
+    }));
+}
+
+static std::mutex appliedLock;
+static std::condition_variable appliedCondition;
+static unsigned int appliedCount = 0;
+
+static void onUpdatesApplied(double) {
+    std::lock_guard<std::mutex> guard(appliedLock);
+    appliedCount++;
+    appliedCondition.notify_all();
+}
+
+/// Runs f and waits for the service to report that the updates it queued were applied, returns -1 on a timeout
+static double timeApply(std::function<void()> f) {
+    std::unique_lock<std::mutex> lock(appliedLock);
+    unsigned int before = appliedCount;
+    lock.unlock();
+    auto start = std::chrono::steady_clock::now();
+    f();
+    lock.lock();
+    if(!appliedCondition.wait_for(lock, std::chrono::seconds(APPLY_TIMEOUT), [before] { return appliedCount > before; })) {
+        return -1;
+    }
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void benchServiceState(std::vector<Measurement> & results, PyramidASRService & service, std::vector<Grammar> & grammars, unsigned int runs, std::string state) {
+    for(Grammar & g : grammars) {
+        std::cerr << "Timing applyUpdates with " << g.name << " while " << state << std::endl;
+        Measurement grammar{"setGrammar+applyUpdates", g.name, g.rules, state, {}};
+        Measurement mode{"setGrammar+setRecognitionMode", g.name, g.rules, state, {}};
+        for(unsigned int i = 0; i < runs; i++) {
+            double ms = timeApply([&] {
+                service.setGrammar(nameGrammar(g, state + std::to_string(i)));
+                service.applyUpdates();
+            });
+            if(ms >= 0) {
+                grammar.ms.push_back(ms);
+            }
+            //Back to the language model, then over to the grammar again in the same call a dialogue turn would make
+            timeApply([&] { service.setRecognitionMode("lm"); });
+            ms = timeApply([&] {
+                service.setGrammar(nameGrammar(g, state + "-mode" + std::to_string(i)));
+                service.setRecognitionMode("jsgf");
+            });
+            if(ms >= 0) {
+                mode.ms.push_back(ms);
+            }
+        }
+        results.push_back(grammar);
+        results.push_back(mode);
+    }
+}
+
+static void benchService(std::vector<Measurement> & results, std::vector<Grammar> & grammars, unsigned int runs) {
+    PyramidASRService service;
+    service.updatesApplied.connect(sigc::ptr_fun(onUpdatesApplied));
+    //Make the first grammar current so every run after it is a switch between grammars
+    timeApply([&] {
+        service.setGrammar(nameGrammar(grammars.front(), "initial"));
+        service.setRecognitionMode("jsgf");
+    });
+
+    benchServiceState(results, service, grammars, runs, "idle");
+
+    service.startListening();
+    for(unsigned int i = 0; i < LISTEN_TIMEOUT * 10 && !service.isListening(); i++) {
+        usleep(100000);
+    }
+    if(!service.isListening()) {
+        std::cerr << "Unable to start listening, skipping the listening runs" << std::endl;
+        return;
+    }
+    benchServiceState(results, service, grammars, runs, "listening");
+    service.stopListening();
+}
+
+static void writeJSON(std::vector<Measurement> & results, unsigned int runs) {
+    std::cout << "{\n  \"runs\": " << runs << ",\n  \"results\": [";
+    for(size_t i = 0; i < results.size(); i++) {
+        Measurement & m = results[i];
+        std::sort(m.ms.begin(), m.ms.end());
+        double total = 0;
+        for(double ms : m.ms) {
+            total += ms;
+        }
+        std::cout << ((i == 0) ? "" : ",") << "\n    {\"operation\": \"" << m.operation << "\", \"state\": \"" << m.state << "\"";
+        if(!m.grammar.empty()) {
+            std::cout << ", \"grammar\": \"" << m.grammar << "\", \"rules\": " << m.rules;
+        }
+        std::cout << ", \"samples\": " << m.ms.size();
+        if(!m.ms.empty()) {
+            std::cout << std::fixed << std::setprecision(3)
+                      << ", \"mean-ms\": " << total / m.ms.size()
+                      << ", \"min-ms\": " << m.ms.front()
+                      << ", \"p50-ms\": " << m.ms[m.ms.size() / 2]
+                      << ", \"max-ms\": " << m.ms.back();
+        }
+        std::cout << "}";
+    }
+    std::cout << "\n  ]\n}" << std::endl;
+}
+
+int main(int argc, char * argv[]) {
+    unsigned int runs = 5;
+    std::string grammarPath = "res/confirm.gram", lmPath = DEFAULT_LM_PATH, hmmPath = DEFAULT_HMM_PATH, dictPath = DEFAULT_DICT_PATH;
+    bool service = false;
+    for(int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if(i + 1 < argc && arg == "-runs") {
+            runs = (unsigned int) atoi(argv[++i]);
+        }
+        else if(i + 1 < argc && arg == "-grammar") {
+            grammarPath = argv[++i];
+        }
+        else if(i + 1 < argc && arg == "-lm") {
+            lmPath = argv[++i];
+        }
+        else if(i + 1 < argc && arg == "-hmm") {
+            hmmPath = argv[++i];
+        }
+        else if(i + 1 < argc && arg == "-dict") {
+            dictPath = argv[++i];
+        }
+        else if(arg == "-service") {
+            service = true;
+        }
+        else if(i + 1 < argc && arg == "-config") {
+            if(chdir(argv[++i]) != 0) {
+                std::cerr << "Unable to change to " << argv[i] << std::endl;
+                return 1;
+            }
+        }
+        else {
+            runs = 0;
+            break;
+        }
+    }
+    if(runs == 0) {
+        std::cerr << "Usage: " << argv[0] << " [-runs N] [-grammar path] [-lm path] [-hmm path] [-dict path] [-service] [-config directory]" << std::endl;
+        return 1;
+    }
+
+    std::ifstream in(grammarPath);
+    if(!in) {
+        std::cerr << "Unable to read " << grammarPath << std::endl;
+        return 1;
+    }
+    std::stringstream text;
+    text << in.rdbuf();
+    //Put the name marker in place of the grammar's own name so it can be renamed like the generated ones
+    std::string confirm = text.str();
+    size_t start = confirm.find("grammar ");
+    size_t end = confirm.find(';', start);
+    if(start != std::string::npos && end != std::string::npos) {
+        confirm.replace(start + 8, end - start - 8, GRAMMAR_NAME_MARKER);
+    }
+
+    std::vector<Grammar> grammars = {{"confirm", countRules(confirm), confirm}};
+    for(unsigned int rules : {100, 1000, 10000}) {
+        grammars.push_back(generateGrammar(rules));
+    }
+
+    std::vector<Measurement> results;
+    benchDecoder(results, grammars, runs, lmPath, hmmPath, dictPath);
+    if(service) {
+        benchService(results, grammars, runs);
+    }
+    writeJSON(results, runs);
+    return 0;
+}
@@ -0,0 +1,78 @@
+/// Throughput microbenchmark for AudioResampler and the stereo downmix.
+/// Usage: pyramid-resampler-bench [seconds of audio per run]
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+#include "AudioResampler.h"
+#include "AudioRingBuffer.h"
+
+struct Conversion {
+    unsigned int inputRate;
+    unsigned int outputRate;
+    unsigned int channels;
+};
+
+static void runConversion(Conversion c, unsigned int seconds) {
+    //A chirp with some noise so the work does not depend on a particular signal
+    std::vector<int16> input((size_t) c.inputRate * seconds * c.channels);
+    unsigned int seed = 1;
+    for(size_t i = 0; i < input.size(); i++) {
+        double t = (double) (i / c.channels) / c.inputRate;
+        seed = seed * 1103515245 + 12345;
+        input[i] = (int16) (8000 * sin(2 * M_PI * (200 + 1000 * t) * t) + ((seed >> 16) % 512) - 256);
+    }
+
+    //Feed it in the same sized pieces the capture thread would
+    AudioResampler resampler(c.inputRate, c.outputRate);
+    int32 chunk = resampler.getMaxInput(AUDIO_FRAME_SIZE) * c.channels;
+    std::vector<int16> scratch(chunk);
+    std::vector<int16> output(AUDIO_FRAME_SIZE);
+
+    auto start = std::chrono::steady_clock::now();
+    size_t produced = 0;
+    for(size_t i = 0; i < input.size(); i += chunk) {
+        int32 count = (int32) std::min((size_t) chunk, input.size() - i);
+        std::copy(input.begin() + i, input.begin() + i + count, scratch.begin());
+        int32 mono = AudioResampler::downmix(scratch.data(), count, c.channels);
+        produced += resampler.process(scratch.data(), mono, output.data());
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    double inputFrames = (double) input.size() / c.channels;
+    std::cout << std::setw(6) << c.inputRate << " -> " << std::setw(6) << c.outputRate << " x" << c.channels << "ch: "
+              << std::fixed << std::setprecision(1) << inputFrames / elapsed / 1e6 << " Msamples/s in, "
+              << std::setprecision(0) << seconds / elapsed << "x real time, "
+              << produced << " samples out" << std::endl;
+}
+
+int main(int argc, char * argv[]) {
+    unsigned int seconds = 60;
+    if(argc > 1) {
+        seconds = (unsigned int) atoi(argv[1]);
+        if(seconds == 0) {
+            std::cerr << "Usage: " << argv[0] << " [seconds of audio per run]" << std::endl;
+            return 1;
+        }
+    }
+
+    Conversion conversions[] = {
+        {16000, 16000, 1},
+        {48000, 16000, 1},
+        {48000, 16000, 2},
+        {44100, 16000, 1},
+        {44100, 16000, 2},
+        {32000, 16000, 1},
+        {22050, 16000, 1},
+        {8000, 16000, 1},
+    };
+
+    for(Conversion & c : conversions) {
+        runConversion(c, seconds);
+    }
+    return 0;
+}
@@ -0,0 +1,64 @@
+#ifndef AUDIOFILE_H
+#define AUDIOFILE_H
+
+#include <string>
+#include <vector>
+#include <cstdio>
+
+#include <sphinxbase/prim_type.h>
+
+#include "AudioResampler.h"
+
+/// Reads 16 bit PCM audio from a WAV file, or from a headerless raw file, as mono samples at the rate the decoders run at.
+/// Multi-channel files are downmixed and other sample rates resampled on the fly, the file is streamed so memory use does not
+/// depend on its length. Files opened from a descriptor are mapped into memory instead, and samples that need no conversion
+/// are handed out straight from the mapping.
+class AudioFile {
+    public:
+        /// outputRate is the rate samples are returned at, raw files are assumed to be mono at that rate
+        AudioFile(int outputRate);
+        ~AudioFile();
+
+        /// Opens the file, returns false and sets the error message if it can not be read
+        bool open(std::string path);
+        /// Maps the file fd refers to, which must not change size while it is open. fd can be closed once this returns.
+        bool open(int fd);
+        void close();
+        /// Reads up to count samples into out, returns the number read, 0 at the end of the file or -1 on a read error
+        int32 read(int16 * out, int32 count);
+        /// Same as above, but points samples at the audio instead of copying it when it is mapped and already mono at outputRate.
+        /// Otherwise samples points into a buffer of count samples owned by this AudioFile. Either stays valid until the next call.
+        int32 read(const int16 ** samples, int32 count);
+
+        /// Length of the file in seconds, from its header or size
+        double getDuration();
+        unsigned int getSampleRate();
+        unsigned int getChannels();
+        std::string getError();
+
+    protected:
+        /// Parses the RIFF header and leaves the file positioned at the start of the sample data
+        bool readWAVHeader();
+        /// Checks the start of the file for a RIFF header and sets up the sample data either way
+        bool readHeader();
+        /// Reads or skips bytes from whichever of file or mapping is open, returning the number of bytes read or skipped
+        size_t readBytes(void * buffer, size_t count);
+        void skipBytes(uint64_t count);
+
+        FILE * file;
+        const unsigned char * mapping; // nullptr unless opened from a descriptor
+        size_t mappingSize;
+        size_t mappingOffset; // Position of the next byte to read from mapping
+        int outputRate;
+        unsigned int sampleRate; // Rate of the samples in the file
+        unsigned int channels;
+        uint64_t dataLeft; // Bytes of sample data not read yet
+        uint64_t dataSize;
+        std::string error;
+
+        AudioResampler * resampler; // nullptr if the file is already at outputRate
+        std::vector<int16> scratch; // Holds interleaved samples read from the file before they are downmixed and resampled
+        std::vector<int16> converted; // Output of read for callers that do not supply a buffer
+};
+
+#endif // AUDIOFILE_H
@@ -0,0 +1,68 @@
+#ifndef AUDIORECORDER_H
+#define AUDIORECORDER_H
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdio>
+#include <stdint.h>
+
+#include "AudioRingBuffer.h"
+
+#define DEFAULT_RECORD_BUFFER_BLOCKS 64 // Blocks the recorder can hold while the disk is busy before it starts dropping them
+#define DEFAULT_RECORD_DIRECTORY "recordings" // Relative to the running directory
+#define RECORDER_WRITE_INTERVAL 1000 // Milliseconds between the writer thread's batched writes
+
+/// Archives audio to WAV files without the recording thread ever touching the disk.
+/// Blocks are copied into a preallocated ring and a background thread wakes up every RECORDER_WRITE_INTERVAL to write everything
+/// queued since in one sequential write. If the disk falls behind far enough to fill the ring, new blocks are dropped and counted.
+/// push and endSegment must only ever be called from one thread at a time.
+class AudioRecorder {
+    public:
+        /// Files are named prefix-date-time-N.wav inside of directory
+        AudioRecorder(std::string directory, std::string prefix, int sampleRate, unsigned int bufferBlocks = DEFAULT_RECORD_BUFFER_BLOCKS);
+        /// Writes out whatever is still queued and closes the current file
+        ~AudioRecorder();
+
+        /// Queues a copy of the block, never blocks. Returns false if the ring was full and the block was dropped.
+        bool push(const AudioBlock & block);
+        /// Finishes the current file, the next block pushed starts a new one
+        void endSegment();
+
+        uint64_t getDroppedBlocks();
+        uint64_t getWrittenBytes();
+        uint64_t getFileCount();
+
+    protected:
+        static void writerLoop(AudioRecorder * r);
+        /// Moves everything queued into the batch, closing files at segment ends, then writes the batch out
+        void drain();
+        void writeBatch();
+        bool openFile();
+        /// Fills in the sizes in the WAV header and closes the file
+        void closeFile();
+
+        AudioRingBuffer queue; // A block with a frameCount of 0 marks the end of a segment
+        std::vector<int16> batch; // Samples taken off the queue that have not been written yet
+        std::string directory;
+        std::string prefix;
+        int sampleRate;
+        FILE * file; // nullptr between segments
+        uint32_t fileBytes; // Sample data written to the current file
+        unsigned int fileIndex;
+        bool warned; // Set once a failure to open a file has been logged, so a full disk does not flood the log
+
+        std::thread writer;
+        std::mutex stopLock;
+        std::condition_variable stopCondition;
+        bool stopping;
+
+        std::atomic<uint64_t> droppedBlocks;
+        std::atomic<uint64_t> writtenBytes;
+        std::atomic<uint64_t> fileCount;
+};
+
+#endif // AUDIORECORDER_H
@@ -0,0 +1,48 @@
+#ifndef AUDIORESAMPLER_H
+#define AUDIORESAMPLER_H
+
+#include <vector>
+#include <stdint.h>
+
+#include <sphinxbase/prim_type.h>
+
+#define RESAMPLER_TAPS_PER_PHASE 32 // Filter taps applied for every output sample when not downsampling, more taps give a sharper anti-aliasing filter
+
+/// Streaming polyphase resampler for 16 bit mono audio, converts between any two integer sample rates.
+/// The filter is stored as one short fixed point FIR per phase, laid out so that every output sample is a single contiguous
+/// int16 dot product the compiler can vectorize. Nothing is allocated after the first call unless the input gets larger.
+class AudioResampler {
+    public:
+        /// When downsampling, tapsPerPhase is multiplied by how many times lower the output rate is, rounded up, so the transition band
+        /// narrows along with the cutoff instead of letting the frequencies just above the new Nyquist frequency alias back in.
+        AudioResampler(unsigned int inputRate, unsigned int outputRate, unsigned int tapsPerPhase = RESAMPLER_TAPS_PER_PHASE);
+
+        /// Resamples count input samples into out, which must have room for getMaxOutput(count) samples.
+        /// Returns the number of samples written. Filter state carries over between calls so a stream can be fed in pieces.
+        int32 process(const int16 * in, int32 count, int16 * out);
+        /// Forgets the filter state, call before starting on an unrelated stream
+        void reset();
+
+        /// Most samples process can write for count input samples
+        int32 getMaxOutput(int32 count);
+        /// Most input samples that can be passed to process without writing more than outputCapacity samples
+        int32 getMaxInput(int32 outputCapacity);
+        unsigned int getInputRate();
+        unsigned int getOutputRate();
+
+        /// Averages interleaved channels into mono in place, count is the total number of samples. Returns the number of mono samples.
+        static int32 downmix(int16 * samples, int32 count, unsigned int channels);
+
+    protected:
+        unsigned int inputRate;
+        unsigned int outputRate;
+        unsigned int upFactor; // The input is conceptually upsampled by upFactor, filtered and then decimated by downFactor
+        unsigned int downFactor;
+        unsigned int taps;
+
+        std::vector<int16> coefficients; // upFactor phases of taps Q15 coefficients, each ordered to line up with the input window
+        std::vector<int16> window; // The last taps - 1 input samples followed by the input being processed
+        uint64_t position; // Time of the next output sample in the upsampled domain, relative to the first new input sample
+};
+
+#endif // AUDIORESAMPLER_H
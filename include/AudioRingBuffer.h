@@ -0,0 +1,83 @@
+#ifndef AUDIORINGBUFFER_H
+#define AUDIORINGBUFFER_H
+
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <stdint.h>
+
+#include <sphinxbase/prim_type.h>
+
+#define AUDIO_FRAME_SIZE 2048
+
+/// A single block of PCM audio as read from the audio device.
+struct AudioBlock {
+    int16 samples[AUDIO_FRAME_SIZE];
+    int32 frameCount; // Number of samples actually stored in samples
+    std::chrono::steady_clock::time_point capturedAt; // When the capture thread finished reading the block
+};
+
+/// Preallocated single-producer/single-consumer ring of audio blocks.
+/// The capture thread is the only writer and the decoding thread is the only reader, so no locking is needed.
+/// Blocks are filled and drained in place, the ring never allocates after construction.
+class AudioRingBuffer {
+    public:
+        AudioRingBuffer(unsigned int blockCount);
+        ~AudioRingBuffer();
+
+        /// Producer: Returns the next free block to fill, or nullptr if the ring is full.
+        AudioBlock * beginWrite();
+        /// Producer: Publishes the block returned by beginWrite to the consumer.
+        void commitWrite();
+
+        /// Consumer: Returns the oldest filled block, or nullptr if the ring is empty.
+        AudioBlock * beginRead();
+        /// Consumer: Releases the block returned by beginRead back to the producer.
+        void commitRead();
+
+        /// Discards all buffered blocks. Only call this while there is no active producer.
+        void clear();
+
+        bool isEmpty();
+        unsigned int size();
+        unsigned int capacity();
+
+        /// Called by the producer when a captured block had to be dropped because the ring was full
+        void recordOverrun();
+        /// Called by the consumer when the ring stayed empty for longer than the producer should ever take to fill a block
+        void recordUnderrun();
+
+        uint64_t getOverrunCount();
+        uint64_t getUnderrunCount();
+
+    protected:
+        AudioBlock * blocks;
+        unsigned int slotCount; // One more than the capacity so that a full ring can be told apart from an empty one
+
+        std::atomic<unsigned int> writeIndex; // Only modified by the producer
+        std::atomic<unsigned int> readIndex; // Only modified by the consumer
+
+        std::atomic<uint64_t> overruns;
+        std::atomic<uint64_t> underruns;
+};
+
+/// Fixed size history of the most recently heard audio blocks, used to replay audio that was held back from a decoder.
+/// Once full the oldest block is overwritten. Only ever used by one thread, so it is not synchronized.
+class AudioHistory {
+    public:
+        AudioHistory(unsigned int blockCount);
+
+        /// Copies the block into the history
+        void push(const AudioBlock & block);
+        /// Returns the i-th block held, 0 being the oldest
+        AudioBlock & at(unsigned int i);
+        unsigned int size();
+        void clear();
+
+    protected:
+        std::vector<AudioBlock> blocks;
+        unsigned int start; // Index of the oldest block
+        unsigned int count;
+};
+
+#endif // AUDIORINGBUFFER_H
@@ -0,0 +1,53 @@
+#ifndef COMPILEDGRAMMAR_H
+#define COMPILEDGRAMMAR_H
+
+#include <string>
+#include <memory>
+#include <future>
+#include <mutex>
+#include <chrono>
+
+#include <sphinxbase/jsgf.h>
+#include <sphinxbase/fsg_model.h>
+#include "pocketsphinx.h"
+
+class CompiledGrammar;
+
+/// A grammar that is being compiled on a background thread, shared by every decoder that is going to install it
+typedef std::shared_future<std::shared_ptr<CompiledGrammar>> PendingGrammar;
+
+/// A JSGF grammar compiled once into a finite state grammar and shared by every decoder in the pool.
+/// Each decoder builds its own search around the same FSG with ps_set_fsg instead of parsing and compiling the JSGF again.
+/// sphinxbase reference counts an FSG with a plain int, so every call that can retain or release a shared FSG, on any decoder,
+/// has to hold getReferenceLock: installing it, and unsetting, reinitializing or freeing searches that may have been built around one.
+class CompiledGrammar {
+    public:
+        /// Starts compiling the JSGF text on a background thread
+        static PendingGrammar compileString(std::string jsgf, float32 logBase, float32 languageWeight);
+        /// Starts compiling the JSGF file on a background thread
+        static PendingGrammar compileFile(std::string pathToJSGF, float32 logBase, float32 languageWeight);
+
+        ~CompiledGrammar();
+
+        /// Returns false if the grammar failed to parse or had no public rule
+        bool isValid();
+        /// Adds the grammar to the decoder as a search under the given name, returns the result of ps_set_fsg
+        int install(ps_decoder_t * ps, std::string searchName);
+        /// Serializes every change to the reference counts of the shared FSGs
+        static std::mutex & getReferenceLock();
+        std::string getSource();
+        std::chrono::microseconds getCompileTime();
+
+    protected:
+        CompiledGrammar(std::string source);
+        /// Builds the FSG from a parsed grammar's public rule, frees the grammar afterwards
+        static std::shared_ptr<CompiledGrammar> build(std::string source, jsgf_t * grammar, float32 logBase, float32 languageWeight);
+
+        std::string source; // JSGF text or the path it was loaded from
+        logmath_t * logmath; // The FSG's transition probabilities are in this log base, it must match the decoders'
+        fsg_model_t * fsg;
+        std::chrono::microseconds compileTime;
+        static std::mutex referenceLock; // Also covers pocketsphinx adding filler and alternate pronunciation transitions to the FSG on its first install
+};
+
+#endif // COMPILEDGRAMMAR_H
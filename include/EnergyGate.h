@@ -0,0 +1,35 @@
+#ifndef ENERGYGATE_H
+#define ENERGYGATE_H
+
+#include <stdint.h>
+
+#include <sphinxbase/prim_type.h>
+
+#define DEFAULT_VAD_THRESHOLD -50.0 // Level in dBFS a block has to reach to be handed to the decoder
+#define DEFAULT_VAD_HANGOVER 1000 // Milliseconds the gate stays open after the last loud block, must outlast pocketsphinx's own end of speech detection
+#define DEFAULT_VAD_PREROLL 300 // Milliseconds of audio from before the gate opened that are handed to the decoder along with the loud block
+
+/// Cheap energy based voice activity gate that runs in front of the decoders.
+/// Blocks quieter than the threshold can not contain speech, so they do not need to go through pocketsphinx at all.
+/// Once a block is loud enough the gate stays open for the hangover period so that quiet parts of speech and the trailing
+/// silence pocketsphinx needs to end an utterance still reach the decoder.
+class EnergyGate {
+    public:
+        EnergyGate(double thresholdDB, unsigned int hangoverSamples);
+
+        /// Returns true if the block should be decoded
+        bool process(const int16 * samples, int32 count);
+        /// Returns true if the last block processed was let through
+        bool isOpen();
+
+        /// Returns the sum of the squares of the samples
+        static int64_t sumOfSquares(const int16 * samples, int32 count);
+
+    protected:
+        double threshold; // Mean square sample value corresponding to the threshold in dBFS
+        unsigned int hangover; // In samples
+        unsigned int hangoverLeft;
+        bool open;
+};
+
+#endif // ENERGYGATE_H
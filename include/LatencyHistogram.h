@@ -0,0 +1,36 @@
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+
+#define HISTOGRAM_SUB_BUCKETS 8 // Linear buckets per power of two, so a percentile is off by at most 1/8th of its value
+#define HISTOGRAM_MAX_EXPONENT 40 // Values of 2^40 microseconds and more all land in the last bucket
+#define HISTOGRAM_BUCKETS ((HISTOGRAM_MAX_EXPONENT - 2) * HISTOGRAM_SUB_BUCKETS)
+
+/// Log-linear histogram of durations in microseconds that any number of threads can record into without locking.
+/// Recording is a handful of integer operations and one relaxed atomic increment. Percentiles are read from a snapshot of the
+/// counters, so they can be slightly off while values are being recorded but never block the recording threads.
+class LatencyHistogram {
+    public:
+        LatencyHistogram();
+
+        void record(uint64_t microseconds);
+        /// Records the time since start
+        void recordSince(std::chrono::steady_clock::time_point start);
+
+        /// Returns the value in microseconds below which the given fraction of the recorded values fall, 0 if nothing was recorded
+        uint64_t getPercentile(double fraction);
+        uint64_t getCount();
+        void reset();
+
+    protected:
+        static unsigned int bucketFor(uint64_t value);
+        /// Largest value that lands in the bucket
+        static uint64_t bucketLimit(unsigned int bucket);
+
+        std::atomic<uint64_t> buckets[HISTOGRAM_BUCKETS];
+};
+
+#endif // LATENCYHISTOGRAM_H
@@ -1,15 +1,90 @@
 #include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <list>
+#include <map>
+#include <queue>
 #include <string>
 #include <atomic>
 #include <thread>
 #include <vector>
 
 #include <glib.h>
+#include <sigc++/sigc++.h>
 
 #include "ASRService.h"
 #include "SphinxDecoder.h"
+#include "AudioRingBuffer.h"
+#include "EnergyGate.h"
+#include "AudioResampler.h"
+#include "AudioFile.h"
+#include "AudioRecorder.h"
+#include "LatencyHistogram.h"
+#include "Tracer.h"
 
-#define AUDIO_FRAME_SIZE 2048
+#define DEFAULT_AUDIO_BUFFER_BLOCKS 32 // Number of AUDIO_FRAME_SIZE blocks the capture ring can hold, about 4 seconds at 16kHz
+#define AUDIO_POLL_INTERVAL 5000 // Microseconds the capture thread sleeps when the device has no frames ready
+#define AUDIO_WAIT_TIMEOUT 100 // Milliseconds the decoding thread waits for captured audio before re-checking its state
+#define AUDIO_UNDERRUN_TIMEOUT 500 // Milliseconds the decoding thread can go without audio while capturing before it counts as an underrun
+#define KEYWORD_HISTORY_BLOCKS 16 // Blocks of audio kept while waiting for the wake phrase and replayed to the decoder pool once it is spotted
+#define KEYWORD_WAKE_TIMEOUT 5000 // Milliseconds to wait for speech after the wake phrase before waiting for it again
+#define DEFAULT_PARTIAL_HYPOTHESIS_RATE 4 // Most PartialHypothesis signals sent per second during an utterance
+
+/// A decoder whose utterance has ended and that is waiting for its hypothesis to be extracted
+struct FinalizeJob {
+    SphinxDecoder * decoder;
+    std::chrono::steady_clock::time_point queuedAt;
+    std::chrono::steady_clock::time_point releasedAt; // When the push to speak button went up, left at the epoch for continuous utterances
+};
+
+#define DEFAULT_TRANSCRIPTION_WORKERS 0 // Decoders transcribing files at once, 0 means one per core
+#define TRANSCRIPTION_IDLE_TIMEOUT 30 // Seconds a transcription worker keeps its decoder after running out of files
+
+/// A file queued for transcription by transcribeFile or transcribeBatch
+struct TranscriptionJob {
+    uint32_t id; // Tags every signal emitted for this job
+    uint32_t batchId; // Batch the file belongs to, 0 if it was queued on its own
+    std::string path; // Only used in messages for jobs read from fd
+    int fd; // Sealed memfd passed to transcribeFd, owned by the job. -1 for files read from path.
+};
+
+/// Files given to transcribeBatch. They are moved into the transcription queue a few at a time as workers free up.
+struct TranscriptionBatch {
+    std::vector<std::string> paths;
+    size_t nextFile; // Index of the next file to queue
+    uint32_t completed;
+    double audioTime; // Seconds of audio transcribed so far
+    std::chrono::steady_clock::time_point startedAt;
+};
+
+/// The search configuration last requested over DBus, used to set up decoders that are created outside of the pool
+/// and pool decoders that were still being brought up when the change was made
+struct SearchConfiguration {
+    unsigned int generation; // Bumped on every change so decoders set up from an older configuration can be spotted
+    std::string hmmPath;
+    std::string dictPath;
+    std::string grammar; // Empty until setGrammar is called
+    PendingGrammar compiledGrammar;
+    std::string jsgfPath; // Empty until updateJSGFPath is called
+    PendingGrammar compiledJSGFFile;
+    std::string lmPath; // Empty until setLanguageModel is called
+    std::string logPath; // Empty until updateLogPath is called
+    bool modeSelected;
+    SphinxHelper::SearchMode mode;
+};
+
+#define STREAM_POLL_INTERVAL 100 // Longest a stream thread blocks waiting for audio before checking whether it should exit, in milliseconds
+
+/// A client pushing raw 16 bit PCM into the service over a pipe or socket passed to attachAudioStream
+struct AudioStream {
+    uint32_t id; // Tags every signal emitted for this stream
+    int fd; // Owned by the stream and closed once it ends
+    unsigned int sampleRate; // Rate the client sends samples at
+    std::thread thread;
+    std::atomic<bool> finished; // Set by the stream's thread just before it exits so it can be joined
+};
 
 enum class ListeningMode {
     CONTINUOUS, PUSH_TO_SPEAK
@@ -23,10 +98,15 @@ class PyramidASRService : public Buckey::ASRService {
         
         void setGrammar(std::string jsgf);
         void setLanguageModel(std::string lmpath);
+        ///Puts the service into wake phrase mode, the decoder pool only hears audio after keyword is spotted. An empty keyword turns it off.
         void setKeyword(std::string keyword);
         
         void startListening();
         void stopListening();
+        ///Stops the audio device without ending the management thread, resumeListening picks up with only fresh audio.
+        ///In push to speak mode these are the same as stopListening and startListening.
+        void pauseListening();
+        void resumeListening();
         
         PyramidASRService();	
         virtual ~PyramidASRService();
@@ -42,36 +122,276 @@ class PyramidASRService : public Buckey::ASRService {
         void updateLogPath(std::string path);
         void updateJSGFPath(std::string path);
         void updateDictionary(std::string path);
+        ///Applies queued updates in the background, updatesApplied is emitted when done
         void applyUpdates();
         
         bool isListening();
+        
+        ///Returns a snapshot of the service's runtime counters, keyed by counter name
+        std::map<std::string, double> getStats();
+        ///Returns the work each decoder has done since the last call, keyed by decoder and then by counter name. Every counter starts over from zero.
+        std::map<std::string, std::map<std::string, double>> takeDecoderAccounting();
+        ///Writes the trace events from the last trace-seconds to path, or to trace-file if path is empty. Returns false if tracing is off or the file could not be written.
+        bool dumpTrace(std::string path);
+        
+        ///Queues a raw or WAV file to be transcribed as fast as possible, returns the job id its signals are tagged with
+        uint32_t transcribeFile(std::string path);
+        ///Queues the audio in a memfd sealed against writes and shrinking to be transcribed straight out of memory, the service takes ownership
+        ///of fd. Returns the job id, transcriptionResult carries the transcript once it is done.
+        uint32_t transcribeFd(int fd);
+        ///Queues a list of files to be spread across the transcription workers, returns the batch id its signals are tagged with
+        uint32_t transcribeBatch(std::vector<std::string> paths);
+        
+        ///Starts decoding raw mono 16 bit PCM at sampleRate read from fd, which the service takes ownership of. 0 means the configured samprate.
+        ///Returns the stream id its signals are tagged with. The stream ends when the client closes its end.
+        uint32_t attachAudioStream(int fd, uint32_t sampleRate);
+        
+        ///PartialHypothesis is only computed while at least one client is subscribed
+        void subscribePartialHypotheses();
+        void unsubscribePartialHypotheses();
            
         std::atomic<bool> running;
+        
+        sigc::signal<void, double> updatesApplied; // Emitted with the time taken in milliseconds once applyUpdates has finished
+        sigc::signal<void, std::string> keywordSpotted; // Emitted with the keyphrase when the wake phrase is heard
+        sigc::signal<void, std::string> partialHypothesis; // Emitted with the in-progress hypothesis whenever it changes during an utterance
+        sigc::signal<void, uint32_t, std::string> fileHypothesis; // Emitted with the job id and hypothesis for every utterance in a transcribed file
+        sigc::signal<void, uint32_t, double, double> transcriptionFinished; // Emitted with the job id, seconds of audio and real time factor
+        sigc::signal<void, uint32_t, std::string> transcriptionFailed; // Emitted with the job id and the reason
+        sigc::signal<void, uint32_t, std::string, std::vector<std::string>, std::vector<double>, std::vector<double>, double> transcriptionResult; // Emitted for transcribeFd jobs with the job id, transcript, its words with their start and end times in seconds, and the decode time
+        sigc::signal<void, uint32_t, uint32_t, std::string> batchFileStarted; // Emitted with the batch id, job id and path when a worker picks up a file from a batch
+        sigc::signal<void, uint32_t, uint32_t, uint32_t> batchProgress; // Emitted with the batch id, files done and total files every time a file in a batch finishes
+        sigc::signal<void, uint32_t, double, double> batchFinished; // Emitted with the batch id, seconds of audio and real time factor of the whole batch
+        sigc::signal<void, uint32_t, std::string, double> streamHypothesis; // Emitted with the stream id, hypothesis and milliseconds from the end of speech arriving to the hypothesis
+        sigc::signal<void, uint32_t, double, double, double> streamClosed; // Emitted with the stream id, seconds of audio and the average and worst hypothesis latency in milliseconds
 	        
 	protected:	
-	    ///Callback for when the utterance ends and the hypothesis needs extracted
-        static void endAndGetHypothesis(PyramidASRService * sr, SphinxDecoder * sd);
-        ///Management function for press to speak mode
+	    ///Callback for when the utterance ends and the hypothesis needs extracted, silenceAt is when the end of speech was detected
+        static void endAndGetHypothesis(PyramidASRService * sr, SphinxDecoder * sd, std::chrono::steady_clock::time_point silenceAt);
+        ///Worker loop for the finalization pool, pulls decoders off finalizeQueue and runs endAndGetHypothesis on them
+        static void finalizationWorker(PyramidASRService * sr);
+        ///Hands a decoder whose utterance just ended over to the finalization pool
+        void queueFinalization(SphinxDecoder * sd, std::chrono::steady_clock::time_point releasedAt = std::chrono::steady_clock::time_point());
+        ///Management function for press to speak mode. startListening presses the button and stopListening releases it, audio captured
+        ///while it is up is kept in preRoll and a warm decoder is held ready so the utterance starts the moment it goes down.
         static void pushToSpeakRecognition(PyramidASRService * sr);
+        ///Wakes the push to speak management thread after paused changed
+        void togglePushToSpeak();
+        ///Blocks the continuous management thread until resumeListening, emptying the audio ring once the capture thread has stopped the device
+        void waitWhilePaused();
         ///Management function for continuous speech mode
         static void continuousSpeechRecognition(PyramidASRService * sr);
+        ///Opens the configured audio device and starts the capture thread on it, returns nullptr if the device could not be opened
+        ///If suspendOnPause is set the capture thread stops the device and sleeps whenever paused is set
+        static ad_rec_t * startCapture(PyramidASRService * sr, bool suspendOnPause);
+        ///Stops the capture thread and closes the device
+        static void stopCapture(PyramidASRService * sr, ad_rec_t * ad);
+        ///Reads frames from the audio device into the audio ring buffer, runs on its own thread so slow decoding never stalls capture
+        static void audioCaptureLoop(PyramidASRService * sr, ad_rec_t * ad);
+        
+        ///Creates every decoder in the pool, decoder 0 first and then the rest concurrently. Runs on startupThread.
+        static void bringUpDecoders(PyramidASRService * sr);
+        ///Creates decoder number index set up with the current search configuration, starts an utterance on it and publishes it to the idle queue
+        static void createDecoder(PyramidASRService * sr, unsigned short index);
+        ///Blocks until every decoder in the pool has been created, call before touching all of the decoders
+        void waitForDecoders();
         
-        std::atomic<unsigned short> currentDecoderIndex;
-        std::vector<SphinxDecoder *> decoders;
-        std::mutex decoderIndexLock;
-        std::mutex updateLock;
+        ///Sets endLoop and wakes the management thread so it notices
+        void requestLoopEnd();
+        
+        ///Returns the next block of captured audio, waiting up to AUDIO_WAIT_TIMEOUT for one. Returns nullptr if none arrived.
+        AudioBlock * waitForAudio();
+        
+        ///Pops the longest idle decoder off idleDecoders, waiting until one is released if none are idle.
+        ///Returns nullptr if cancel is set or every decoder has errored out while waiting.
+        SphinxDecoder * acquireDecoder(std::atomic<bool> & cancel);
+        ///Returns a decoder with a started utterance to the idle queue. Errored decoders are dropped from rotation.
+        ///While updates are being applied, decoders that still have updates queued are handed to updateWorker instead.
+        void releaseDecoder(SphinxDecoder * sd);
+        ///Runs queued transcription jobs on a decoder of its own, created when there is work and freed after TRANSCRIPTION_IDLE_TIMEOUT without any.
+        ///transcriptionWorkerCount of these run at once.
+        static void transcriptionWorker(PyramidASRService * sr, unsigned int index);
+        ///Decodes the job's file with sd without any real time pacing, emitting fileHypothesis for each utterance.
+        ///Returns the length of the file in seconds, or -1 if it could not be transcribed.
+        double transcribe(SphinxDecoder * sd, TranscriptionJob & job);
+        ///Moves files from the pending batches into transcriptionQueue until it holds transcriptionQueueLimit jobs, transcriptionLock must be held
+        void refillTranscriptionQueue();
+        ///Records that a file from a batch has finished and emits the batch signals
+        void finishBatchFile(uint32_t batchId, double audioTime);
+        ///Creates a decoder outside of the pool set up with the current search configuration
+        SphinxDecoder * createStandaloneDecoder(std::string name, unsigned int & generation);
+        ///Brings sd up to date with c, applying the updates straight away if applyUpdate is set and queueing them otherwise
+        static void applySearchConfiguration(SphinxDecoder * sd, const SearchConfiguration & c, bool applyUpdate);
+        ///Keeps the accounting of a decoder outside of the pool until the next takeDecoderAccounting, then deletes it
+        void retireDecoder(SphinxDecoder * sd);
+        ///Records a change to the search configuration without waiting for the pool to come up. With searchConfigurationLock held, queue is
+        ///called on every pool decoder published so far and then func on searchConfiguration. Decoders still being brought up pick the change up
+        ///from searchConfiguration before they are published.
+        void updateSearchConfiguration(std::function<void(SearchConfiguration &)> func, std::function<void(SphinxDecoder *)> queue);
+        ///Returns the first pool decoder published so far that is not errored, or nullptr if there is none yet
+        SphinxDecoder * findUsableDecoder();
+        ///Decodes one client stream on a standalone decoder of its own until the client hangs up. Runs on the stream's own thread.
+        static void streamWorker(PyramidASRService * sr, AudioStream * stream);
+        ///Joins and frees streams whose threads have exited, streamLock must be held
+        void reapStreams();
+        ///Emits partialHypothesis if the decoder's in-progress hypothesis changed from last and partialInterval has passed since lastAt
+        void updatePartialHypothesis(SphinxDecoder * sd, std::string & last, std::chrono::steady_clock::time_point & lastAt);
+        ///Decodes a block with the keyword decoder while waiting for the wake phrase, or with sd otherwise. Returns true if sd heard speech.
+        bool decodeBlock(AudioBlock * block, SphinxDecoder * sd, bool & awake, std::chrono::steady_clock::time_point & awakeAt);
+        ///Feeds a block to the keyword decoder and remembers it in keywordHistory, returns true if the wake phrase was spotted
+        bool spotKeyword(AudioBlock * block);
+        ///Feeds keywordHistory to the pool decoder and empties it, returns true if the last block contained speech
+        bool replayKeywordHistory(SphinxDecoder * sd);
+        ///Replaces the keyword decoder with a new one using hmmPath and dictPath, keywordLock must be held
+        bool createKeywordDecoder();
+        ///Rebuilds the keyword decoder after the model or dictionary changed
+        void resetKeywordDecoder();
+        ///Returns true if none of the decoders are usable anymore, idleLock must be held
+        bool allDecodersErrored();
+        ///Returns the number of usable decoders that still have updates queued
+        unsigned short countStaleDecoders();
+        
+        ///Applies the queued updates whenever applyUpdates is called. The decoders not in use are updated first as a shadow set
+        ///and swapped in together, then the rest are updated as they finish their utterances. Runs on updateThread.
+        static void updateWorker(PyramidASRService * sr);
+        ///Applies a decoder's queued updates and restarts its utterance, returns false if it errored out
+        static bool updateDecoder(SphinxDecoder * sd);
+        
+        std::vector<SphinxDecoder *> decoders; // Entries are nullptr until created by bringUpDecoders, assigned while holding idleLock
+        std::thread startupThread;
+        std::mutex startupLock; // Serializes waitForDecoders
+        bool readySignalled; // Set once the first decoder has been published and the READY state sent
+        std::atomic<SphinxDecoder *> currentDecoder; // The decoder being fed audio by the management thread, nullptr between utterances
+        std::deque<SphinxDecoder *> idleDecoders; // Decoders with a warm utterance started that are not in use
+        std::deque<SphinxDecoder *> updateBacklog; // Decoders released while updates are being applied that still need updating
+        std::mutex idleLock; // Protects decoders, idleDecoders, updateBacklog, applyingUpdates and the statistics below
+        std::condition_variable decoderAvailable; // Notified whenever a decoder is released
+        bool applyingUpdates;
+        std::atomic<bool> swapRequested; // Set by updateWorker to ask the management thread to give up currentDecoder at the next silent block
+        
+        std::thread updateThread;
+        std::mutex updateLock; // Protects updateRequested and endUpdates
+        std::condition_variable updateCondition;
+        bool updateRequested;
+        bool endUpdates; // Setting to true requests updateWorker to exit
+        
+        std::chrono::microseconds handoffLastLatency; // Time from the end of speech until the next decoder was picked up
+        std::chrono::microseconds handoffMaxLatency;
+        
+        //Startup timing breakdown, protected by idleLock
+        std::chrono::microseconds configLoadTime;
+        std::chrono::microseconds firstDecoderTime; // From the start of bring up until decoder 0 was published
+        std::chrono::microseconds poolReadyTime; // From the start of bring up until every decoder was created
+        std::vector<std::chrono::microseconds> decoderStartupTimes;
         
         std::thread recognizerLoop; // The "management thread" that handles the sphinx decoders
-        std::vector<std::thread> miscThreads; //Holds threads used to retreive the hypothesis        
+        std::thread captureThread; // Fills audioBuffer from the audio device
+        
+        std::vector<std::thread> finalizeWorkers; // Fixed pool of threads used to retreive the hypothesis, one per decoder
+        std::queue<FinalizeJob> finalizeQueue;
+        std::mutex finalizeLock; // Protects finalizeQueue, endFinalize and the finalize statistics below
+        std::condition_variable finalizeAvailable;
+        bool endFinalize; // Setting to true requests the finalization workers to exit once finalizeQueue is empty
+        
+        size_t finalizePeakDepth;
+        uint64_t finalizeCount;
+        std::chrono::microseconds finalizeTotalLatency; // Summed time from queueFinalization to the hypothesis being emitted
+        std::chrono::microseconds finalizeMaxLatency;
+        std::chrono::microseconds finalizeLastLatency;
+        uint64_t pushToSpeakCount; // Push to speak utterances finalized so far
+        std::chrono::microseconds pushToSpeakTotalLatency; // Summed time from the button going up to the hypothesis being emitted
+        std::chrono::microseconds pushToSpeakMaxLatency;
+        std::chrono::microseconds pushToSpeakLastLatency;
+        
+        std::atomic<unsigned int> partialSubscribers;
+        std::chrono::microseconds partialInterval; // Minimum time between PartialHypothesis signals, zero disables them
+        std::atomic<uint64_t> partialCount;
+        
+        SphinxDecoder * keywordDecoder; // Listens for the wake phrase, nullptr until setKeyword is first called
+        std::mutex accountingLock; // Protects standaloneDecoders and retiredAccounting
+        std::list<SphinxDecoder *> standaloneDecoders; // Live decoders outside of the pool, the keyword decoder included
+        std::map<std::string, std::map<std::string, double>> retiredAccounting; // Accounting of deleted decoders not yet taken, keyed by decoder name
+        
+        std::mutex keywordLock; // Protects keywordDecoder and keyword
+        std::string keyword;
+        double keywordThreshold;
+        std::atomic<bool> keywordSpotting; // Set while the decoder pool is gated behind the wake phrase
+        AudioHistory * keywordHistory; // Latest blocks heard by the keyword decoder, only touched by the management thread
+        std::atomic<uint64_t> keywordHits;
+        //Microseconds of CPU time spent in each stage
+        std::atomic<uint64_t> keywordCPUTime;
+        std::atomic<uint64_t> decodeCPUTime;
+        std::atomic<uint64_t> finalizeCPUTime;
+        //Wall clock time of each stage of the pipeline, recorded from whichever thread runs it
+        LatencyHistogram captureQueueLatency; // From ad_read returning to the block being taken off audioBuffer
+        LatencyHistogram decodeBlockLatency; // ps_process_raw on a single block
+        LatencyHistogram endUtteranceLatency; // From the end of speech being detected to ps_end_utt returning
+        LatencyHistogram hypothesisLatency; // ps_get_hyp
+        LatencyHistogram emitLatency; // From the hypothesis being ready to hypothesisCallback returning
+        
+        EnergyGate * energyGate; // nullptr unless energy-vad is turned on
+        AudioHistory * preRoll; // Quiet blocks the energy gate held back, or audio from before the push to speak button went down. Only touched by the management thread.
+        std::atomic<uint64_t> vadSkippedBlocks;
+        
+        std::vector<std::thread> transcriptionWorkers;
+        unsigned int transcriptionWorkerCount;
+        std::deque<TranscriptionJob> transcriptionQueue; // Jobs ready for a worker to pick up
+        size_t transcriptionQueueLimit; // Batches are only moved into transcriptionQueue up to this many jobs
+        std::map<uint32_t, TranscriptionBatch> batches; // Batches that still have files queued or being transcribed
+        unsigned int activeTranscriptionDecoders;
+        std::mutex transcriptionLock; // Protects transcriptionQueue, batches and the transcription statistics below
+        std::condition_variable transcriptionAvailable;
+        std::atomic<bool> endTranscription; // Setting to true requests transcriptionWorker to exit, abandoning queued jobs
+        std::atomic<uint32_t> nextJobId;
+        uint64_t transcriptionCount;
+        double transcriptionAudioTime; // Seconds of audio transcribed
+        double transcriptionDecodeTime; // Seconds spent transcribing it
+        double transcriptionLastRTF;
+        
+        std::list<AudioStream *> streams;
+        std::mutex streamLock; // Protects streams and the stream statistics below
+        std::atomic<bool> endStreams; // Setting to true requests every stream thread to exit
+        uint64_t streamCount;
+        uint64_t streamUtterances;
+        std::chrono::microseconds streamTotalLatency; // Summed time from the end of speech arriving on a stream to its hypothesis
+        std::chrono::microseconds streamMaxLatency;
         
         std::atomic<bool> inUtterance;
         std::atomic<bool> endLoop; // Setting to true requests the running management thread to exit
         std::atomic<bool> voiceDetected;
         
         std::atomic<bool> listening; // Set to true while the management thread is running
-        std::atomic<bool> paused;
+        std::atomic<bool> paused; // In push to speak mode, set while the button is up
+        std::atomic<bool> pushToSpeakToggled; // Set by togglePushToSpeak to cut waitForAudio short
+        std::chrono::steady_clock::time_point pushToSpeakReleasedAt;
+        bool captureSuspendsOnPause; // Set before the capture thread starts, false in push to speak mode where capture has to go on while paused
+        std::mutex pauseLock; // Protects captureParked and resumedAt
+        std::condition_variable pauseCondition; // Notified when paused is cleared, the capture thread parks or capture ends
+        bool captureParked; // Set while the capture thread has the device stopped for a pause
+        std::chrono::steady_clock::time_point resumedAt;
+        std::atomic<uint64_t> pauseCount;
+        std::atomic<uint64_t> resumeLastLatency; // Microseconds from resumeListening to the first block of audio arriving
+        std::atomic<uint64_t> resumeMaxLatency;
+        
+        AudioRecorder * recorder; // nullptr unless record-audio is turned on
+        bool recordCapture; // Everything captured is recorded by the capture thread, one file per listening session
+        bool recordUtterances; // Each utterance is recorded to its own file by the management thread
+        
+        double traceSeconds; // How far back dumpTrace reaches
+        std::string traceFile; // Where dumpTrace writes to when not given a path
+        std::atomic<bool> capturing; // Set to true while the capture thread is running, cleared to request it to stop
+        
+        AudioResampler * captureResampler; // nullptr unless deviceRate differs from sampleRate, only used by the capture thread
+        AudioRingBuffer * audioBuffer;
+        std::mutex audioLock;
+        std::condition_variable audioAvailable; // Notified by the capture thread whenever a block is added to audioBuffer
+        std::chrono::steady_clock::time_point starvedSince; // When the decoding thread last found audioBuffer empty, only used by waitForAudio
+        bool starved; // Set while audioBuffer has been empty since starvedSince, cleared once audio arrives again
+        bool underrunCounted; // Set once the current dry spell has been counted as an underrun
         
         SphinxHelper::SearchMode searchMode;
+        SearchConfiguration searchConfiguration;
+        std::mutex searchConfigurationLock; // Held while pool decoders are published to decoders, idleLock may be taken inside of it
         ListeningMode listeningMode;
            
         GKeyFile * configFile;
@@ -79,9 +399,13 @@ class PyramidASRService : public Buckey::ASRService {
         
         //Values read from the config file
         unsigned short maxDecoders;
+        unsigned short audioBufferBlocks;
+        unsigned short searchCacheSize;
         std::string hmmPath;
         std::string lmPath;
         std::string dictPath;
         std::string device;
+        int sampleRate; // Rate the decoders run at
+        int deviceRate; // Rate the audio device is opened at, resampled to sampleRate by the capture thread if different
 	   
 };
\ No newline at end of file
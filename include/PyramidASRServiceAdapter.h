@@ -7,11 +7,22 @@
 #include <string>
 #include "ASRServiceAdapter.h"
 #include "PyramidASRService.h"
+#include "Tracer.h"
 
 class PyramidASRServiceAdapter : public Buckey::ASRServiceAdapter {
     protected:
         PyramidASRServiceAdapter(PyramidASRService * adaptee, std::string path);
+        
+        ///Unwraps the passed descriptor for PyramidASRService::attachAudioStream
+        uint32_t attachAudioStream(DBus::FileDescriptor::pointer fd, uint32_t sampleRate);
+        ///Unwraps the passed descriptor for PyramidASRService::transcribeFd
+        uint32_t transcribeFd(DBus::FileDescriptor::pointer fd);
+        
+        PyramidASRService * service;
     public:
+        ///Records every method call as a trace event when tracing is on, then dispatches it as usual
+        virtual DBus::HandlerResult handle_message(DBus::Connection::pointer connection, DBus::Message::const_pointer message);
+
         static std::shared_ptr<PyramidASRServiceAdapter> create(PyramidASRService * adaptee, std::string path);
 };
 #endif /* PYRAMIDASRSERVICEADAPTER_H */
@@ -0,0 +1,22 @@
+#ifndef RESIDENTMEMORY_H
+#define RESIDENTMEMORY_H
+
+#include <cstdio>
+#include <unistd.h>
+
+/// Returns the resident set size of this process in kilobytes, or -1 if it could not be read
+inline long getResidentMemory() {
+    FILE * statm = fopen("/proc/self/statm", "r");
+    if(statm == NULL) {
+        return -1;
+    }
+    long size, resident;
+    int res = fscanf(statm, "%ld %ld", &size, &resident);
+    fclose(statm);
+    if(res != 2) {
+        return -1;
+    }
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+#endif // RESIDENTMEMORY_H
@@ -3,14 +3,19 @@
 
 #include <string>
 #include <queue>
+#include <list>
+#include <vector>
+#include <unordered_map>
 #include <iostream>
 #include <atomic>
 #include <functional>
 #include <mutex>
+#include <chrono>
 
 #include <sphinxbase/err.h>
 #include <sphinxbase/ad.h>
 #include "SphinxHelper.h"
+#include "CompiledGrammar.h"
 #include "pocketsphinx.h"
 #include "cmd_ln.h"
 
@@ -22,6 +27,33 @@
 #define KEYWORD_SEARCH_NAME "keyword-search"
 #define ALLPHONE_SEARCH_NAME "allphone-search"
 
+#define DEFAULT_SAMPLE_RATE 16000 // Sample rate of the audio fed to the decoders, has to match what the acoustic model was trained on
+#define DEFAULT_KEYWORD_THRESHOLD 1e-20 // Detection threshold for keyphrase searches, lower values spot more keyphrases and more false alarms
+#define DEFAULT_SEARCH_CACHE_SIZE 4 // Number of compiled JSGF/LM searches each decoder keeps resident
+#define DECODER_STATE_COUNT 5 // Number of values in SphinxHelper::DecoderState
+
+/// A compiled search kept resident inside of a decoder so that switching back to it does not recompile it
+struct CachedSearch {
+    std::string name; // Name of the search inside of pocketsphinx
+    std::string source; // JSGF text, or the path (and modification time) it was loaded from
+};
+
+/// A word from the last hypothesis and when it was said, in seconds from the start of the utterance
+struct WordTiming {
+    std::string word;
+    double start;
+    double end;
+};
+
+/// Work a decoder has done since its accounting was last taken
+struct DecoderAccounting {
+    double audioSeconds; // Audio fed to ps_process_raw
+    double cpuSeconds; // Thread CPU time spent in ps_process_raw, ps_end_utt and ps_get_hyp
+    uint64_t utterances; // Utterances ended
+    uint64_t errors; // Failed pocketsphinx calls, including the ones that put the decoder into the ERROR state
+    double stateSeconds[DECODER_STATE_COUNT]; // Wall clock time spent in each SphinxHelper::DecoderState, indexed by the state
+};
+
 /// All functions (and constructors and destructors) are synchronous. Any asynchronous tasks should be carried out by a managing class (SphinxRecognizer).
 /// This class serves as a bare bones C++ wrapper for the CMU pocketsphinx library with a few added convenience functions.
 class SphinxDecoder
@@ -29,11 +61,11 @@ class SphinxDecoder
     friend class PyramidASRService;
     public:
         /// The pathToSearchFile is either the path to the language model or the path to the JSGF grammar. Depends on the specified searchMode.
-        SphinxDecoder(std::string decoderName, std::string pathToHMM = DEFAULT_HMM_PATH, std::string pathToDictionary = DEFAULT_DICT_PATH, std::string pathToLogFile = DEFAULT_LOG_PATH);
+        SphinxDecoder(std::string decoderName, std::string pathToHMM = DEFAULT_HMM_PATH, std::string pathToDictionary = DEFAULT_DICT_PATH, std::string pathToLogFile = DEFAULT_LOG_PATH, int sampleRate = DEFAULT_SAMPLE_RATE);
         ~SphinxDecoder();
 
         const bool isReady();
-        bool processRawAudio(int16 adbuf[], int32 frameCount);
+        bool processRawAudio(const int16 adbuf[], int32 frameCount);
 
         // Dictionary manipulation
         const bool wordExists(std::string word);
@@ -44,6 +76,11 @@ class SphinxDecoder
         void startUtterance();
         void endUtterance();
         std::string getHypothesis();
+        /// Returns the best hypothesis so far without ending the utterance
+        std::string getPartialHypothesis();
+        /// Appends the words of the hypothesis just returned by getHypothesis to words, skipping silences and fillers.
+        /// offset is added to every time, pass the position of the utterance in the audio to get times relative to the whole stream.
+        void getWordTimings(std::vector<WordTiming> & words, double offset = 0);
 
         //Updating methods
         void updateAcousticModel(std::string pathToHMM, bool applyUpdate = false);
@@ -52,6 +89,10 @@ class SphinxDecoder
         void updateJSGFFile(std::string pathToJSGF, bool applyUpdate = false);
 		void updateLoggingFile(std::string pathToLog, bool applyUpdate = false);
 		void updateJSGFString(std::string jsgf, bool applyUpdate = false);
+		void updateKeyword(std::string keyphrase, double threshold = DEFAULT_KEYWORD_THRESHOLD, bool applyUpdate = false);
+		/// Same as above, but installs the given shared grammar instead of compiling the JSGF inside of this decoder
+		void updateJSGFFile(std::string pathToJSGF, PendingGrammar grammar, bool applyUpdate = false);
+		void updateJSGFString(std::string jsgf, PendingGrammar grammar, bool applyUpdate = false);
 	
 		void selectSearchMode(SphinxHelper::SearchMode mode, bool applyUpdate = false);
 
@@ -60,22 +101,50 @@ class SphinxDecoder
         char * getHMMPath();
         std::string getJSGFPath();
         std::string getJSGFString();
+        std::string getKeyword();
         std::string getLMPath();
         char * getLogPath();
+        /// Log base and language weight the decoder was configured with, grammars compiled for it must use the same
+        float32 getLogBase();
+        float32 getLanguageWeight();
         std::string getName();
+        int getSampleRate();
         const SphinxHelper::DecoderState getState();
+        bool hasPendingUpdates();
 
         cmd_ln_t * getConfig();
+        
+        //Search cache
+        void setSearchCacheSize(unsigned int size);
+        uint64_t getSearchCacheHits();
+        uint64_t getSearchCacheMisses();
+        uint64_t getSearchCacheEvictions();
+        
+        /// Returns the accounting gathered since the last call and starts over from zero. Safe to call from any thread.
+        DecoderAccounting takeAccounting();
 
     protected:
+        /// Builds a decoder configuration for the given model, dictionary and sample rate. Returns NULL if it could not be created.
+        static cmd_ln_t * createConfig(std::string pathToHMM, std::string pathToDictionary, std::string pathToLogFile, int sampleRate);
         static void _updateAcousticModel(SphinxDecoder * d, std::string pathToHMM);
         static void _updateDictionary(SphinxDecoder * d, std::string pathToDict);        
 		static void _updateLoggingFile(SphinxDecoder * d, std::string pathToLog);
 		static void _updateLM(SphinxDecoder * d, std::string pathToLM);
-        static void _updateJSGFFile(SphinxDecoder * d, std::string pathToJSGF);
-		static void _updateJSGFString(SphinxDecoder * d, std::string jsgf);
+        static void _updateJSGFFile(SphinxDecoder * d, std::string pathToJSGF, PendingGrammar grammar);
+		static void _updateJSGFString(SphinxDecoder * d, std::string jsgf, PendingGrammar grammar);
+		static void _updateKeyword(SphinxDecoder * d, std::string keyphrase, double threshold);
 		static void _selectSearchMode(SphinxDecoder * d, SphinxHelper::SearchMode mode);
 		
+		/// Looks up the search compiled from source. On a hit it is marked most recently used, its name is stored in name and true is returned.
+		/// On a miss a new unique search name is stored in name for the caller to compile into, followed by a call to _cacheSearch.
+		static bool _findCachedSearch(SphinxDecoder * d, std::string prefix, std::string source, std::string & name);
+		/// Records a newly compiled search, evicting the least recently used searches that are not active past searchCacheSize
+		static void _cacheSearch(SphinxDecoder * d, std::string name, std::string source);
+		/// Forgets every cached search, used after ps_reinit throws them away
+		static void _clearSearchCache(SphinxDecoder * d);
+		/// Makes the search for the current recognition mode active if it is the given search type
+		static void _activateSearch(SphinxDecoder * d, SphinxHelper::SearchMode mode);
+		
         char hmmPath[256]; // path to the acoustic model
 		char logPath[256]; // path to the logging file
         
@@ -83,17 +152,40 @@ class SphinxDecoder
         std::string lmPath; // path to the language model
         std::string jsgfPath; // path to the jsgf grammar
         std::string jsgfString;
+        std::string keyword; // keyphrase to spot
 		std::string name;
+		int sampleRate;
+		float32 logBase;
+		float32 languageWeight;
 
 		SphinxHelper::SearchMode recognitionMode;
+		bool searchSelected; // Set once a search mode has been selected, until then pocketsphinx's default search is used
 		bool ready;
 		bool inUtterance;
 		
-		bool jsgfFileSearchSet;
-		bool jsgfStringSearchSet;
-		bool lmSearchSet;
+		// Names of the searches currently selected for each search mode, empty if none has been set
+		std::string jsgfFileSearchName;
+		std::string jsgfStringSearchName;
+		std::string lmSearchName;
+		
+		std::list<CachedSearch> searchCache; // Most recently used first
+		std::unordered_map<std::string, std::list<CachedSearch>::iterator> searchCacheIndex; // Keyed by search name
+		unsigned int searchCacheSize;
+		std::atomic<uint64_t> searchCacheHits;
+		std::atomic<uint64_t> searchCacheMisses;
+		std::atomic<uint64_t> searchCacheEvictions;
 
 		std::atomic<SphinxHelper::DecoderState> state;
+		/// Every change of state goes through here so the time spent in the old state is accounted for
+		void setState(SphinxHelper::DecoderState newState);
+		
+		std::atomic<uint64_t> audioSamples;
+		std::atomic<uint64_t> cpuTime; // Microseconds
+		std::atomic<uint64_t> utterances;
+		std::atomic<uint64_t> errors;
+		std::mutex accountingLock; // Protects stateTime and stateEnteredAt
+		std::chrono::microseconds stateTime[DECODER_STATE_COUNT];
+		std::chrono::steady_clock::time_point stateEnteredAt;
 		
 		std::queue<std::function<void()>> updateQueue;
 		std::mutex queueLock;
@@ -7,7 +7,7 @@ namespace SphinxHelper {
     };
 
     enum SearchMode {
-    	JSGF_FILE, JSGF_STRING, LM, ALLPHONE
+    	JSGF_FILE, JSGF_STRING, LM, ALLPHONE, KEYWORD
     };
 
     enum DecoderState {
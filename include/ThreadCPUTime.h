@@ -0,0 +1,14 @@
+#ifndef THREADCPUTIME_H
+#define THREADCPUTIME_H
+
+#include <stdint.h>
+#include <time.h>
+
+/// Returns the CPU time used by the calling thread in microseconds
+inline uint64_t threadCPUTime() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+#endif // THREADCPUTIME_H
@@ -0,0 +1,91 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define TRACE_BUFFER_EVENTS 16384 // Events each thread keeps, the oldest are overwritten once it is full
+#define TRACE_NAME_LENGTH 48 // Longer event names are cut short
+#define DEFAULT_TRACE_SECONDS 30 // How far back a dump reaches
+#define DEFAULT_TRACE_FILE "pyramid-trace.json" // Relative to the running directory
+
+/// A single event as stored in a thread's buffer
+struct TraceEvent {
+    char name[TRACE_NAME_LENGTH];
+    const char * category; // Always a string literal
+    char phase; // 'X' for a complete event with a duration, 'i' for an instant
+    pid_t tid;
+    uint64_t start; // Microseconds on the steady clock
+    uint64_t duration;
+};
+
+/// Timeline of what every thread in the service was doing, written out in the Chrome trace format that chrome://tracing and Perfetto load.
+/// Each thread records into a buffer of its own without any locking, and a dump collects the recent events from all of them.
+/// While tracing is off every trace point costs one relaxed atomic load and a branch, nothing is allocated until a thread records something.
+class Tracer {
+    public:
+        static inline bool isEnabled() {
+            return enabled.load(std::memory_order_relaxed);
+        }
+        static void setEnabled(bool on);
+
+        /// Microseconds on the steady clock, the time base of every event
+        static uint64_t now();
+        /// Records an instant event, the check is inline so a disabled trace point never leaves the caller
+        static inline void instant(const char * category, const char * name) {
+            if(isEnabled()) {
+                recordInstant(category, name);
+            }
+        }
+        /// Records an event that started at start and ends now
+        static void complete(const char * category, const char * name, uint64_t start);
+
+        /// Writes the events from the last given seconds of every thread to path. Returns false if the file could not be written.
+        static bool dump(std::string path, double seconds);
+
+    protected:
+        struct ThreadBuffer {
+            std::atomic<uint64_t> written; // Events ever recorded, only modified by the owning thread
+            TraceEvent events[TRACE_BUFFER_EVENTS];
+        };
+
+        /// Hands the thread's buffer back for reuse when the thread exits
+        struct ThreadHandle {
+            ThreadBuffer * buffer = nullptr;
+            pid_t tid = 0;
+            ~ThreadHandle();
+        };
+        static thread_local ThreadHandle handle;
+
+        /// Returns the calling thread's buffer, taking one over from a thread that exited or allocating one on first use
+        static ThreadBuffer * threadBuffer();
+        static void record(const char * category, const char * name, char phase, uint64_t start, uint64_t duration);
+        static void recordInstant(const char * category, const char * name);
+
+        static std::atomic<bool> enabled;
+        static std::mutex buffersLock; // Protects buffers and freeBuffers
+        static std::vector<ThreadBuffer *> buffers; // Every buffer ever allocated, they live until the process exits
+        static std::vector<ThreadBuffer *> freeBuffers; // Buffers whose thread exited, their events are kept until they are reused
+};
+
+/// Records a complete event covering its own lifetime when tracing is on
+class TraceScope {
+    public:
+        TraceScope(const char * category, const char * name) : category(category), name(name), start(Tracer::isEnabled() ? Tracer::now() : 0) {}
+        ~TraceScope() {
+            if(start != 0) {
+                Tracer::complete(category, name, start);
+            }
+        }
+
+    protected:
+        const char * category;
+        const char * name;
+        uint64_t start; // 0 if tracing was off when the scope was entered
+};
+
+#endif // TRACER_H
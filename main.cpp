@@ -13,10 +13,12 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/un.h>
+#include <sys/signalfd.h>
 
 #include <syslog.h>
 #include <dbus-cxx.h>
 #include <glib.h>
+#include <glib-unix.h>
 
 #include "config.h"
 #include "PyramidASRServiceAdapter.h"
@@ -30,7 +32,9 @@ pid_t PID;
 bool customAddressSet;
 char CUSTOM_ADDRESS[200];
 
-void signalHandler(int);
+sigset_t handledSignals; // Blocked in every thread and read from a signalfd by the main loop instead
+
+gboolean handleSignal(gint fd, GIOCondition condition, gpointer loop);
 void daemonize();
 void registerSignalHandles();
 void doLoop();
@@ -40,31 +44,58 @@ char RUNNING_DIR[200] = DEFAULT_RUNNING_DIRECTORY;
 void registerSignalHandles() {
     //The below signal handler is commented out because dbus-cxx has its own SIGCHLD handler, so setting it to ignore causes issues.
 	//signal(SIGCHLD,SIG_IGN); // ignore child
-	signal(SIGTSTP,signalHandler); /* since we haven't daemonized yet, process the TTY signals */
-	signal(SIGQUIT,signalHandler);
-	signal(SIGHUP,signalHandler);
-	signal(SIGTERM,signalHandler);
 	signal(SIGPIPE,SIG_IGN); //Ignore bad pipe signals for now
+	
+	//Block the signals we handle before any threads are started so they all inherit the mask, the main loop then picks them up
+	//from a signalfd. This keeps the handling out of signal context so it can do real work.
+	sigemptyset(&handledSignals);
+	sigaddset(&handledSignals, SIGHUP);
+	sigaddset(&handledSignals, SIGINT);
+	sigaddset(&handledSignals, SIGQUIT);
+	sigaddset(&handledSignals, SIGTERM);
+	sigaddset(&handledSignals, SIGUSR1);
+	sigaddset(&handledSignals, SIGTSTP); /* since we haven't daemonized yet, process the TTY signals */
+	pthread_sigmask(SIG_BLOCK, &handledSignals, NULL);
 }
 
-void signalHandler(int signal) {
-	switch (signal){
+gboolean handleSignal(gint fd, GIOCondition condition, gpointer loop) {
+	if(!(condition & G_IO_IN)) {
+		//The signalfd went bad, without it nothing can stop us so shut down rather than spin on it
+		syslog(LOG_ERR, "Signal descriptor reported an error, shutting down");
+		service->running.store(false);
+		g_main_loop_quit((GMainLoop *) loop);
+		return G_SOURCE_REMOVE;
+	}
+	
+	struct signalfd_siginfo info;
+	if(read(fd, &info, sizeof(info)) != sizeof(info)) {
+		return G_SOURCE_CONTINUE;
+	}
+	
+	switch (info.ssi_signo){
 		case SIGHUP:
-			//syslog(LOG_INFO,"SIGHUP Signal Received...");
-			///TODO: Make service reload
+			syslog(LOG_INFO,"SIGHUP Signal Received, reopening the log");
+			//The configuration is only read when the service starts, so all there is to reload is the log
+			closelog();
+			openlog("pyramid", LOG_NDELAY | LOG_PID | LOG_CONS, LOG_USER);
 			break;
+		case SIGUSR1:
+			syslog(LOG_INFO,"SIGUSR1 Signal Received, dumping the trace");
+			service->dumpTrace("");
+			break;
+		case SIGINT:
 		case SIGQUIT:
 		case SIGTSTP:
 		case SIGTERM:
-			//syslog(LOG_INFO,"Terminate Signal Received...");
-			///TODO: Make service stop
+			syslog(LOG_INFO,"Terminate Signal Received...");
 			service->running.store(false);
-			//exit(0);
+			g_main_loop_quit((GMainLoop *) loop);
 			break;
 		default:
-			//syslog(LOG_INFO, "Received unknown SIGNAL.");
+			syslog(LOG_INFO, "Received unknown SIGNAL.");
 			break;
 	}
+	return G_SOURCE_CONTINUE;
 }
 
 void doLoop() {
@@ -122,9 +153,23 @@ void doLoop() {
 		service->setPID(PID);
 		service->signalStatus();
 		
-        while(service->running.load()) {
-
+		//Sleep until a signal asks us to stop, DBus calls are handled on the dispatcher's own threads
+		GMainLoop * loop = g_main_loop_new(NULL, FALSE);
+		int signalFD = signalfd(-1, &handledSignals, SFD_CLOEXEC | SFD_NONBLOCK);
+		if(signalFD < 0) {
+			syslog(LOG_ERR, "Unable to create a signalfd, signals will not be handled!");
+		}
+		else {
+			g_unix_fd_add(signalFD, G_IO_IN, handleSignal, loop);
+		}
+		if(service->running.load()) {
+			g_main_loop_run(loop);
+		}
+		g_main_loop_unref(loop);
+		if(signalFD >= 0) {
+			close(signalFD);
 		}
+		syslog(LOG_DEBUG, "Left main loop");
 		delete service;
     }
     catch (std::shared_ptr<DBus::Error> e) {
@@ -188,8 +233,7 @@ void daemonize() {
 	signal(SIGTSTP,SIG_IGN); /* ignore tty signals */
 	signal(SIGTTOU,SIG_IGN);
 	signal(SIGTTIN,SIG_IGN);
-	signal(SIGHUP,signalHandler); /* catch hangup signal */
-	signal(SIGTERM,signalHandler); /* catch kill signal */
+	/* hangup and kill signals are still blocked from registerSignalHandles, the main loop reads them */
 
 	doLoop();
 
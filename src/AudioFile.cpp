@@ -0,0 +1,251 @@
+#include "AudioFile.h"
+
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#define WAVE_FORMAT_PCM 1
+#define WAVE_FORMAT_EXTENSIBLE 0xFFFE
+
+static uint32_t readLE32(const unsigned char * b) {
+    return (uint32_t) b[0] | ((uint32_t) b[1] << 8) | ((uint32_t) b[2] << 16) | ((uint32_t) b[3] << 24);
+}
+
+static uint16_t readLE16(const unsigned char * b) {
+    return (uint16_t) (b[0] | (b[1] << 8));
+}
+
+AudioFile::AudioFile(int outputRate) : file(NULL), mapping(nullptr), mappingSize(0), mappingOffset(0), outputRate(outputRate), sampleRate(outputRate), channels(1), dataLeft(0), dataSize(0), resampler(nullptr) {
+
+}
+
+AudioFile::~AudioFile() {
+    close();
+}
+
+bool AudioFile::open(std::string path) {
+    close();
+    file = fopen(path.c_str(), "rb");
+    if(file == NULL) {
+        error = "Unable to open " + path + ": " + strerror(errno);
+        return false;
+    }
+    return readHeader();
+}
+
+bool AudioFile::open(int fd) {
+    close();
+    struct stat sb;
+    if(fstat(fd, &sb) != 0) {
+        error = std::string("Unable to stat the descriptor: ") + strerror(errno);
+        return false;
+    }
+    if(!S_ISREG(sb.st_mode)) {
+        error = "Only regular files and memfds can be mapped";
+        return false;
+    }
+    if(sb.st_size == 0) {
+        error = "The file is empty";
+        return false;
+    }
+
+    void * m = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(m == MAP_FAILED) {
+        error = std::string("Unable to map the descriptor: ") + strerror(errno);
+        return false;
+    }
+    madvise(m, sb.st_size, MADV_SEQUENTIAL);
+    mapping = (const unsigned char *) m;
+    mappingSize = sb.st_size;
+    mappingOffset = 0;
+    return readHeader();
+}
+
+bool AudioFile::readHeader() {
+    unsigned char magic[4];
+    if(readBytes(magic, 4) == 4 && memcmp(magic, "RIFF", 4) == 0) {
+        if(!readWAVHeader()) {
+            close();
+            return false;
+        }
+    }
+    else {
+        //Headerless, take the whole file as mono samples at the decoders' rate
+        if(mapping != nullptr) {
+            mappingOffset = 0;
+            dataSize = mappingSize;
+        }
+        else {
+            struct stat sb;
+            fstat(fileno(file), &sb);
+            rewind(file);
+            dataSize = sb.st_size;
+        }
+        sampleRate = outputRate;
+        channels = 1;
+        dataLeft = dataSize;
+    }
+
+    if((int) sampleRate != outputRate) {
+        resampler = new AudioResampler(sampleRate, outputRate);
+    }
+    return true;
+}
+
+size_t AudioFile::readBytes(void * buffer, size_t count) {
+    if(mapping == nullptr) {
+        return fread(buffer, 1, count, file);
+    }
+    count = std::min(count, mappingSize - mappingOffset);
+    memcpy(buffer, mapping + mappingOffset, count);
+    mappingOffset += count;
+    return count;
+}
+
+void AudioFile::skipBytes(uint64_t count) {
+    if(mapping == nullptr) {
+        fseek(file, count, SEEK_CUR);
+    }
+    else {
+        mappingOffset += std::min((uint64_t) (mappingSize - mappingOffset), count);
+    }
+}
+
+bool AudioFile::readWAVHeader() {
+    unsigned char header[8];
+    if(readBytes(header, 8) != 8 || memcmp(header + 4, "WAVE", 4) != 0) {
+        error = "Not a WAVE file";
+        return false;
+    }
+
+    bool haveFormat = false;
+    while(readBytes(header, 8) == 8) {
+        uint32_t size = readLE32(header + 4);
+        if(memcmp(header, "fmt ", 4) == 0) {
+            unsigned char fmt[16];
+            if(size < 16 || readBytes(fmt, 16) != 16) {
+                error = "Truncated WAVE format chunk";
+                return false;
+            }
+            uint16_t format = readLE16(fmt);
+            channels = readLE16(fmt + 2);
+            sampleRate = readLE32(fmt + 4);
+            uint16_t bits = readLE16(fmt + 14);
+            if((format != WAVE_FORMAT_PCM && format != WAVE_FORMAT_EXTENSIBLE) || bits != 16 || channels == 0 || sampleRate == 0) {
+                error = "Only 16 bit PCM WAVE files are supported";
+                return false;
+            }
+            skipBytes((size - 16) + (size & 1)); // Chunks are padded to an even size
+            haveFormat = true;
+        }
+        else if(memcmp(header, "data", 4) == 0) {
+            if(!haveFormat) {
+                error = "WAVE data chunk comes before its format chunk";
+                return false;
+            }
+            if(mapping != nullptr) {
+                size = std::min((uint64_t) size, (uint64_t) (mappingSize - mappingOffset)); // Streamed WAVs often leave the size unset
+            }
+            dataSize = size;
+            dataLeft = size;
+            return true;
+        }
+        else {
+            skipBytes(size + (size & 1));
+        }
+    }
+    error = "WAVE file has no data chunk";
+    return false;
+}
+
+void AudioFile::close() {
+    if(file != NULL) {
+        fclose(file);
+        file = NULL;
+    }
+    if(mapping != nullptr) {
+        munmap((void *) mapping, mappingSize);
+        mapping = nullptr;
+    }
+    delete resampler;
+    resampler = nullptr;
+}
+
+int32 AudioFile::read(int16 * out, int32 count) {
+    if((file == NULL && mapping == nullptr) || dataLeft == 0 || count <= 0) {
+        return 0;
+    }
+
+    //Read only as many frames as can come out of the resampler without overflowing out
+    int32 frames = (resampler == nullptr) ? count : resampler->getMaxInput(count);
+    if((uint64_t) frames * channels * sizeof(int16) > dataLeft) {
+        frames = dataLeft / (channels * sizeof(int16));
+        if(frames == 0) {
+            dataLeft = 0;
+            return 0;
+        }
+    }
+
+    int16 * buffer = out;
+    if(resampler != nullptr || channels > 1) {
+        scratch.resize((size_t) frames * channels);
+        buffer = scratch.data();
+    }
+
+    size_t got = readBytes(buffer, (size_t) frames * channels * sizeof(int16)) / (channels * sizeof(int16));
+    if(got == 0) {
+        if(mapping == nullptr && ferror(file)) {
+            error = "Read error";
+            return -1;
+        }
+        dataLeft = 0;
+        return 0;
+    }
+    dataLeft -= got * channels * sizeof(int16);
+
+    int32 mono = AudioResampler::downmix(buffer, got * channels, channels);
+    if(resampler != nullptr) {
+        return resampler->process(buffer, mono, out);
+    }
+    if(buffer != out) {
+        std::copy(buffer, buffer + mono, out);
+    }
+    return mono;
+}
+
+int32 AudioFile::read(const int16 ** samples, int32 count) {
+    //Hand out the mapping itself when the samples need no work, as long as they are aligned
+    if(mapping != nullptr && resampler == nullptr && channels == 1 && ((uintptr_t) (mapping + mappingOffset) % sizeof(int16)) == 0) {
+        if(dataLeft < sizeof(int16) || count <= 0) {
+            dataLeft = 0;
+            return 0;
+        }
+        int32 n = (int32) std::min((uint64_t) count, dataLeft / sizeof(int16));
+        *samples = (const int16 *) (mapping + mappingOffset);
+        mappingOffset += n * sizeof(int16);
+        dataLeft -= n * sizeof(int16);
+        return n;
+    }
+
+    converted.resize(count);
+    *samples = converted.data();
+    return read(converted.data(), count);
+}
+
+double AudioFile::getDuration() {
+    return (double) dataSize / (channels * sizeof(int16)) / sampleRate;
+}
+
+unsigned int AudioFile::getSampleRate() {
+    return sampleRate;
+}
+
+unsigned int AudioFile::getChannels() {
+    return channels;
+}
+
+std::string AudioFile::getError() {
+    return error;
+}
@@ -0,0 +1,171 @@
+#include "AudioRecorder.h"
+
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <chrono>
+#include <sys/stat.h>
+#include "syslog.h"
+
+#define WAV_HEADER_SIZE 44
+
+static void writeLE32(unsigned char * b, uint32_t v) {
+    b[0] = v & 0xFF;
+    b[1] = (v >> 8) & 0xFF;
+    b[2] = (v >> 16) & 0xFF;
+    b[3] = (v >> 24) & 0xFF;
+}
+
+static void writeLE16(unsigned char * b, uint16_t v) {
+    b[0] = v & 0xFF;
+    b[1] = (v >> 8) & 0xFF;
+}
+
+AudioRecorder::AudioRecorder(std::string directory, std::string prefix, int sampleRate, unsigned int bufferBlocks) : queue(bufferBlocks), directory(directory), prefix(prefix), sampleRate(sampleRate), file(nullptr), fileBytes(0), fileIndex(0), warned(false), stopping(false), droppedBlocks(0), writtenBytes(0), fileCount(0) {
+    batch.reserve((size_t) bufferBlocks * AUDIO_FRAME_SIZE);
+    mkdir(directory.c_str(), 0750); // Fine if it already exists
+    writer = std::thread(writerLoop, this);
+}
+
+AudioRecorder::~AudioRecorder() {
+    stopLock.lock();
+    stopping = true;
+    stopLock.unlock();
+    stopCondition.notify_one();
+    writer.join();
+    closeFile();
+}
+
+bool AudioRecorder::push(const AudioBlock & block) {
+    if(block.frameCount <= 0) {
+        return true;
+    }
+    AudioBlock * slot = queue.beginWrite();
+    if(slot == nullptr) {
+        droppedBlocks.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    memcpy(slot->samples, block.samples, block.frameCount * sizeof(int16));
+    slot->frameCount = block.frameCount;
+    queue.commitWrite();
+    return true;
+}
+
+void AudioRecorder::endSegment() {
+    AudioBlock * slot = queue.beginWrite();
+    if(slot == nullptr) {
+        //The marker is lost along with the audio around it, the next segment is appended to the current file
+        droppedBlocks.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    slot->frameCount = 0;
+    queue.commitWrite();
+}
+
+void AudioRecorder::writerLoop(AudioRecorder * r) {
+    std::unique_lock<std::mutex> lock(r->stopLock);
+    while(!r->stopping) {
+        //Sleeping between batches rather than being woken for every block keeps the producer free of any locking
+        r->stopCondition.wait_for(lock, std::chrono::milliseconds(RECORDER_WRITE_INTERVAL), [r] { return r->stopping; });
+        lock.unlock();
+        r->drain();
+        lock.lock();
+    }
+}
+
+void AudioRecorder::drain() {
+    AudioBlock * block;
+    while((block = queue.beginRead()) != nullptr) {
+        if(block->frameCount == 0) {
+            writeBatch();
+            closeFile();
+        }
+        else {
+            batch.insert(batch.end(), block->samples, block->samples + block->frameCount);
+        }
+        queue.commitRead();
+    }
+    writeBatch();
+}
+
+void AudioRecorder::writeBatch() {
+    if(batch.empty()) {
+        return;
+    }
+    if(file == nullptr && !openFile()) {
+        batch.clear(); // Nowhere to put it, openFile already logged why
+        return;
+    }
+    size_t bytes = fwrite(batch.data(), sizeof(int16), batch.size(), file) * sizeof(int16);
+    if(bytes < batch.size() * sizeof(int16)) {
+        syslog(LOG_ERR, "Short write while recording audio: %s", strerror(errno));
+    }
+    fileBytes += bytes;
+    writtenBytes.fetch_add(bytes, std::memory_order_relaxed);
+    batch.clear();
+}
+
+bool AudioRecorder::openFile() {
+    char stamp[32];
+    time_t now = time(NULL);
+    struct tm local;
+    localtime_r(&now, &local);
+    strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &local);
+    std::string path = directory + "/" + prefix + "-" + stamp + "-" + std::to_string(fileIndex++) + ".wav";
+
+    file = fopen(path.c_str(), "wb");
+    if(file == nullptr) {
+        if(!warned) {
+            syslog(LOG_ERR, "Unable to open %s to record audio: %s", path.c_str(), strerror(errno));
+            warned = true;
+        }
+        return false;
+    }
+    warned = false;
+    //Big enough that a whole batch goes to the kernel in one write
+    setvbuf(file, NULL, _IOFBF, batch.capacity() * sizeof(int16));
+
+    //The sizes are filled in by closeFile
+    unsigned char header[WAV_HEADER_SIZE] = {0};
+    memcpy(header, "RIFF", 4);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    writeLE32(header + 16, 16);
+    writeLE16(header + 20, 1); // PCM
+    writeLE16(header + 22, 1); // Mono
+    writeLE32(header + 24, sampleRate);
+    writeLE32(header + 28, sampleRate * sizeof(int16));
+    writeLE16(header + 32, sizeof(int16));
+    writeLE16(header + 34, 16);
+    memcpy(header + 36, "data", 4);
+    fwrite(header, 1, WAV_HEADER_SIZE, file);
+    fileBytes = 0;
+    fileCount.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+void AudioRecorder::closeFile() {
+    if(file == nullptr) {
+        return;
+    }
+    unsigned char size[4];
+    writeLE32(size, fileBytes + WAV_HEADER_SIZE - 8);
+    fseek(file, 4, SEEK_SET);
+    fwrite(size, 1, 4, file);
+    writeLE32(size, fileBytes);
+    fseek(file, 40, SEEK_SET);
+    fwrite(size, 1, 4, file);
+    fclose(file);
+    file = nullptr;
+}
+
+uint64_t AudioRecorder::getDroppedBlocks() {
+    return droppedBlocks.load(std::memory_order_relaxed);
+}
+
+uint64_t AudioRecorder::getWrittenBytes() {
+    return writtenBytes.load(std::memory_order_relaxed);
+}
+
+uint64_t AudioRecorder::getFileCount() {
+    return fileCount.load(std::memory_order_relaxed);
+}
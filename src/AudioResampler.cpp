@@ -0,0 +1,129 @@
+#include "AudioResampler.h"
+
+#include <cmath>
+#include <algorithm>
+
+static unsigned int greatestCommonDivisor(unsigned int a, unsigned int b) {
+    while(b != 0) {
+        unsigned int t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+AudioResampler::AudioResampler(unsigned int inputRate, unsigned int outputRate, unsigned int tapsPerPhase) : inputRate(inputRate), outputRate(outputRate), taps(tapsPerPhase), position(0) {
+    unsigned int g = greatestCommonDivisor(inputRate, outputRate);
+    upFactor = outputRate / g;
+    downFactor = inputRate / g;
+    if(taps == 0) {
+        taps = 1;
+    }
+    //The cutoff is scaled down by downFactor / upFactor below, the filter length has to grow by as much to keep the same transition band
+    taps *= std::max(1u, (downFactor + upFactor - 1) / upFactor);
+
+    //Windowed sinc low pass prototype at the upsampled rate, cut off below the lower of the two Nyquist frequencies
+    unsigned int length = upFactor * taps;
+    double cutoff = 0.5 / std::max(upFactor, downFactor) * 0.95;
+    double center = (length - 1) / 2.0;
+    double span = (length > 1) ? length - 1 : 1;
+    std::vector<double> prototype(length);
+    for(unsigned int n = 0; n < length; n++) {
+        double x = n - center;
+        double sinc = (x == 0) ? 2 * cutoff : sin(2 * M_PI * cutoff * x) / (M_PI * x);
+        double blackman = 0.42 - 0.5 * cos(2 * M_PI * n / span) + 0.08 * cos(4 * M_PI * n / span);
+        prototype[n] = sinc * blackman;
+    }
+
+    //Split into phases. Phase p holds prototype[p + k * upFactor] for tap k, which multiplies the input k samples back from the newest
+    //one in the window, so it is stored reversed to make the dot product run forward over memory.
+    coefficients.resize(upFactor * taps);
+    for(unsigned int p = 0; p < upFactor; p++) {
+        double sum = 0;
+        for(unsigned int k = 0; k < taps; k++) {
+            sum += prototype[p + k * upFactor];
+        }
+        for(unsigned int k = 0; k < taps; k++) {
+            //Normalizing each phase to unity gain keeps the output level the same and stops DC from rippling between phases
+            double c = (sum == 0) ? 0 : prototype[p + k * upFactor] / sum;
+            coefficients[p * taps + (taps - 1 - k)] = (int16) lround(std::max(-32768.0, std::min(32767.0, c * 32768.0)));
+        }
+    }
+
+    window.assign(taps - 1, 0);
+}
+
+int32 AudioResampler::process(const int16 * in, int32 count, int16 * out) {
+    if(count <= 0) {
+        return 0;
+    }
+
+    if(upFactor == downFactor) {
+        std::copy(in, in + count, out);
+        return count;
+    }
+
+    //Append the new input behind the last taps - 1 samples of the previous call
+    window.resize(taps - 1 + count);
+    std::copy(in, in + count, window.begin() + (taps - 1));
+
+    int32 written = 0;
+    uint64_t end = (uint64_t) count * upFactor;
+    while(position < end) {
+        const int16 * c = &coefficients[(position % upFactor) * taps];
+        const int16 * x = &window[position / upFactor];
+        //Fixed point dot product, the phases are normalized so the accumulator can not overflow an int32
+        int32_t acc = 0;
+        for(unsigned int j = 0; j < taps; j++) {
+            acc += (int32_t) c[j] * x[j];
+        }
+        acc = (acc + (1 << 14)) >> 15;
+        out[written++] = (int16) std::max(-32768, std::min(32767, acc));
+        position += downFactor;
+    }
+    position -= end;
+
+    std::copy(window.end() - (taps - 1), window.end(), window.begin());
+    window.resize(taps - 1);
+    return written;
+}
+
+void AudioResampler::reset() {
+    window.assign(taps - 1, 0);
+    position = 0;
+}
+
+int32 AudioResampler::getMaxOutput(int32 count) {
+    return (int32) (((uint64_t) count * upFactor + downFactor - 1) / downFactor) + 1;
+}
+
+int32 AudioResampler::getMaxInput(int32 outputCapacity) {
+    if(outputCapacity <= 1) {
+        return 0;
+    }
+    return (int32) ((uint64_t) (outputCapacity - 1) * downFactor / upFactor);
+}
+
+unsigned int AudioResampler::getInputRate() {
+    return inputRate;
+}
+
+unsigned int AudioResampler::getOutputRate() {
+    return outputRate;
+}
+
+int32 AudioResampler::downmix(int16 * samples, int32 count, unsigned int channels) {
+    if(channels <= 1) {
+        return count;
+    }
+
+    int32 frames = count / channels;
+    for(int32 i = 0; i < frames; i++) {
+        int32_t sum = 0;
+        for(unsigned int ch = 0; ch < channels; ch++) {
+            sum += samples[i * channels + ch];
+        }
+        samples[i] = (int16) (sum / (int32_t) channels);
+    }
+    return frames;
+}
@@ -0,0 +1,96 @@
+#include "AudioRingBuffer.h"
+
+AudioRingBuffer::AudioRingBuffer(unsigned int blockCount) : slotCount(blockCount + 1), writeIndex(0), readIndex(0), overruns(0), underruns(0) {
+    blocks = new AudioBlock[slotCount];
+}
+
+AudioRingBuffer::~AudioRingBuffer() {
+    delete[] blocks;
+}
+
+AudioBlock * AudioRingBuffer::beginWrite() {
+    unsigned int w = writeIndex.load(std::memory_order_relaxed);
+    if((w + 1) % slotCount == readIndex.load(std::memory_order_acquire)) {
+        return nullptr;
+    }
+    return &blocks[w];
+}
+
+void AudioRingBuffer::commitWrite() {
+    unsigned int w = writeIndex.load(std::memory_order_relaxed);
+    writeIndex.store((w + 1) % slotCount, std::memory_order_release);
+}
+
+AudioBlock * AudioRingBuffer::beginRead() {
+    unsigned int r = readIndex.load(std::memory_order_relaxed);
+    if(r == writeIndex.load(std::memory_order_acquire)) {
+        return nullptr;
+    }
+    return &blocks[r];
+}
+
+void AudioRingBuffer::commitRead() {
+    unsigned int r = readIndex.load(std::memory_order_relaxed);
+    readIndex.store((r + 1) % slotCount, std::memory_order_release);
+}
+
+void AudioRingBuffer::clear() {
+    readIndex.store(writeIndex.load(std::memory_order_acquire), std::memory_order_release);
+}
+
+bool AudioRingBuffer::isEmpty() {
+    return readIndex.load(std::memory_order_acquire) == writeIndex.load(std::memory_order_acquire);
+}
+
+unsigned int AudioRingBuffer::size() {
+    unsigned int w = writeIndex.load(std::memory_order_acquire);
+    unsigned int r = readIndex.load(std::memory_order_acquire);
+    return (w + slotCount - r) % slotCount;
+}
+
+unsigned int AudioRingBuffer::capacity() {
+    return slotCount - 1;
+}
+
+void AudioRingBuffer::recordOverrun() {
+    overruns.fetch_add(1, std::memory_order_relaxed);
+}
+
+void AudioRingBuffer::recordUnderrun() {
+    underruns.fetch_add(1, std::memory_order_relaxed);
+}
+
+uint64_t AudioRingBuffer::getOverrunCount() {
+    return overruns.load(std::memory_order_relaxed);
+}
+
+uint64_t AudioRingBuffer::getUnderrunCount() {
+    return underruns.load(std::memory_order_relaxed);
+}
+
+AudioHistory::AudioHistory(unsigned int blockCount) : blocks(blockCount == 0 ? 1 : blockCount), start(0), count(0) {
+
+}
+
+void AudioHistory::push(const AudioBlock & block) {
+    blocks[(start + count) % blocks.size()] = block;
+    if(count < blocks.size()) {
+        count++;
+    }
+    else {
+        start = (start + 1) % blocks.size();
+    }
+}
+
+AudioBlock & AudioHistory::at(unsigned int i) {
+    return blocks[(start + i) % blocks.size()];
+}
+
+unsigned int AudioHistory::size() {
+    return count;
+}
+
+void AudioHistory::clear() {
+    start = 0;
+    count = 0;
+}
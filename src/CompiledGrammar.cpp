@@ -0,0 +1,80 @@
+#include "CompiledGrammar.h"
+
+#include "syslog.h"
+
+std::mutex CompiledGrammar::referenceLock;
+
+CompiledGrammar::CompiledGrammar(std::string source) : source(source), logmath(NULL), fsg(NULL), compileTime(0) {
+
+}
+
+CompiledGrammar::~CompiledGrammar() {
+    //Decoders hold their own references to the FSG, so only ours is dropped here
+    if(fsg != NULL) {
+        std::lock_guard<std::mutex> guard(referenceLock);
+        fsg_model_free(fsg);
+    }
+    if(logmath != NULL) {
+        logmath_free(logmath);
+    }
+}
+
+PendingGrammar CompiledGrammar::compileString(std::string jsgf, float32 logBase, float32 languageWeight) {
+    return std::async(std::launch::async, [jsgf, logBase, languageWeight] {
+        return build(jsgf, jsgf_parse_string(jsgf.c_str(), NULL), logBase, languageWeight);
+    }).share();
+}
+
+PendingGrammar CompiledGrammar::compileFile(std::string pathToJSGF, float32 logBase, float32 languageWeight) {
+    return std::async(std::launch::async, [pathToJSGF, logBase, languageWeight] {
+        return build(pathToJSGF, jsgf_parse_file(pathToJSGF.c_str(), NULL), logBase, languageWeight);
+    }).share();
+}
+
+std::shared_ptr<CompiledGrammar> CompiledGrammar::build(std::string source, jsgf_t * grammar, float32 logBase, float32 languageWeight) {
+    auto start = std::chrono::steady_clock::now();
+    std::shared_ptr<CompiledGrammar> g(new CompiledGrammar(source));
+    if(grammar == NULL) {
+        syslog(LOG_ERR, "Failed to parse JSGF grammar!");
+        return g;
+    }
+
+    jsgf_rule_t * rule = jsgf_get_public_rule(grammar);
+    if(rule == NULL) {
+        syslog(LOG_ERR, "JSGF grammar has no public rule!");
+        jsgf_grammar_free(grammar);
+        return g;
+    }
+
+    g->logmath = logmath_init(logBase, 0, TRUE);
+    g->fsg = jsgf_build_fsg(grammar, rule, g->logmath, languageWeight);
+    jsgf_grammar_free(grammar);
+
+    g->compileTime = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+    syslog(LOG_DEBUG, "Compiled JSGF grammar in %ld us", (long) g->compileTime.count());
+    return g;
+}
+
+bool CompiledGrammar::isValid() {
+    return fsg != NULL;
+}
+
+int CompiledGrammar::install(ps_decoder_t * ps, std::string searchName) {
+    if(fsg == NULL) {
+        return -1;
+    }
+    std::lock_guard<std::mutex> guard(referenceLock);
+    return ps_set_fsg(ps, searchName.c_str(), fsg);
+}
+
+std::mutex & CompiledGrammar::getReferenceLock() {
+    return referenceLock;
+}
+
+std::string CompiledGrammar::getSource() {
+    return source;
+}
+
+std::chrono::microseconds CompiledGrammar::getCompileTime() {
+    return compileTime;
+}
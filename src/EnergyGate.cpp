@@ -0,0 +1,45 @@
+#include "EnergyGate.h"
+
+#include <cmath>
+
+#define FULL_SCALE_POWER (32768.0 * 32768.0)
+
+EnergyGate::EnergyGate(double thresholdDB, unsigned int hangoverSamples) : hangover(hangoverSamples), hangoverLeft(0), open(false) {
+    threshold = FULL_SCALE_POWER * pow(10.0, thresholdDB / 10.0);
+}
+
+bool EnergyGate::process(const int16 * samples, int32 count) {
+    if(count <= 0) {
+        return open;
+    }
+
+    //Compare against the summed power instead of dividing, the only per sample work is in sumOfSquares
+    if(sumOfSquares(samples, count) >= threshold * count) {
+        hangoverLeft = hangover;
+        open = true;
+    }
+    else if(hangoverLeft > (unsigned int) count) {
+        hangoverLeft -= count;
+        open = true;
+    }
+    else {
+        hangoverLeft = 0;
+        open = false;
+    }
+    return open;
+}
+
+bool EnergyGate::isOpen() {
+    return open;
+}
+
+int64_t EnergyGate::sumOfSquares(const int16 * samples, int32 count) {
+    //Kept to a plain widening multiply-accumulate with no branches so the compiler vectorizes it (pmaddwd on x86, smlal on ARM).
+    //Integer addition is associative, so unlike a float sum this vectorizes without -ffast-math.
+    int64_t sum = 0;
+    for(int32 i = 0; i < count; i++) {
+        int32_t s = samples[i];
+        sum += s * s;
+    }
+    return sum;
+}
@@ -0,0 +1,76 @@
+#include "LatencyHistogram.h"
+
+LatencyHistogram::LatencyHistogram() {
+    reset();
+}
+
+unsigned int LatencyHistogram::bucketFor(uint64_t value) {
+    //Values below HISTOGRAM_SUB_BUCKETS get a bucket each, above that every power of two is split into HISTOGRAM_SUB_BUCKETS
+    if(value < HISTOGRAM_SUB_BUCKETS) {
+        return (unsigned int) value;
+    }
+    unsigned int exponent = 63 - __builtin_clzll(value);
+    if(exponent >= HISTOGRAM_MAX_EXPONENT) {
+        return HISTOGRAM_BUCKETS - 1;
+    }
+    unsigned int sub = (value >> (exponent - 3)) & (HISTOGRAM_SUB_BUCKETS - 1);
+    return (exponent - 2) * HISTOGRAM_SUB_BUCKETS + sub;
+}
+
+uint64_t LatencyHistogram::bucketLimit(unsigned int bucket) {
+    if(bucket < HISTOGRAM_SUB_BUCKETS) {
+        return bucket;
+    }
+    unsigned int exponent = bucket / HISTOGRAM_SUB_BUCKETS + 2;
+    uint64_t sub = bucket % HISTOGRAM_SUB_BUCKETS;
+    uint64_t width = (uint64_t) 1 << (exponent - 3);
+    return ((HISTOGRAM_SUB_BUCKETS + sub) << (exponent - 3)) + width - 1;
+}
+
+void LatencyHistogram::record(uint64_t microseconds) {
+    buckets[bucketFor(microseconds)].fetch_add(1, std::memory_order_relaxed);
+}
+
+void LatencyHistogram::recordSince(std::chrono::steady_clock::time_point start) {
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    record(elapsed < 0 ? 0 : (uint64_t) elapsed);
+}
+
+uint64_t LatencyHistogram::getPercentile(double fraction) {
+    uint64_t counts[HISTOGRAM_BUCKETS];
+    uint64_t total = 0;
+    for(unsigned int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        counts[i] = buckets[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+    if(total == 0) {
+        return 0;
+    }
+
+    uint64_t rank = (uint64_t) (fraction * total);
+    if(rank >= total) {
+        rank = total - 1;
+    }
+    uint64_t seen = 0;
+    for(unsigned int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += counts[i];
+        if(seen > rank) {
+            return bucketLimit(i);
+        }
+    }
+    return bucketLimit(HISTOGRAM_BUCKETS - 1);
+}
+
+uint64_t LatencyHistogram::getCount() {
+    uint64_t total = 0;
+    for(unsigned int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        total += buckets[i].load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+void LatencyHistogram::reset() {
+    for(unsigned int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        buckets[i].store(0, std::memory_order_relaxed);
+    }
+}
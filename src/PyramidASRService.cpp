@@ -2,14 +2,23 @@
 #include <iostream>
 #include <chrono>
 #include <algorithm>
+#include <ctime>
+#include <cerrno>
 
 #include "unistd.h"
 #include "syslog.h"
+#include <poll.h>
+#include <fcntl.h>
 
 #include "PyramidASRService.h"
+#include "ResidentMemory.h"
+#include "ThreadCPUTime.h"
 #include "config.h"
 
-PyramidASRService::PyramidASRService() : Buckey::ASRService(PYRAMID_VERSION, "pyramid"), running(true), listening(false), endLoop(false), paused(false) {
+PyramidASRService::PyramidASRService() : Buckey::ASRService(PYRAMID_VERSION, "pyramid"), running(true), readySignalled(false), currentDecoder(nullptr), applyingUpdates(false), swapRequested(false), updateRequested(false), endUpdates(false), handoffLastLatency(0), handoffMaxLatency(0), configLoadTime(0), firstDecoderTime(0), poolReadyTime(0), endFinalize(false), finalizePeakDepth(0), finalizeCount(0), finalizeTotalLatency(0), finalizeMaxLatency(0), finalizeLastLatency(0), pushToSpeakCount(0), pushToSpeakTotalLatency(0), pushToSpeakMaxLatency(0), pushToSpeakLastLatency(0), partialSubscribers(0), partialInterval(0), partialCount(0), keywordDecoder(nullptr), keywordThreshold(DEFAULT_KEYWORD_THRESHOLD), keywordSpotting(false), keywordHits(0), keywordCPUTime(0), decodeCPUTime(0), finalizeCPUTime(0), energyGate(nullptr), vadSkippedBlocks(0), transcriptionWorkerCount(0), transcriptionQueueLimit(0), activeTranscriptionDecoders(0), endTranscription(false), nextJobId(1), transcriptionCount(0), transcriptionAudioTime(0), transcriptionDecodeTime(0), transcriptionLastRTF(0), endStreams(false), streamCount(0), streamUtterances(0), streamTotalLatency(0), streamMaxLatency(0), endLoop(false), listening(false), paused(false), pushToSpeakToggled(false), captureSuspendsOnPause(false), captureParked(false), pauseCount(0), resumeLastLatency(0), resumeMaxLatency(0), recorder(nullptr), recordCapture(false), recordUtterances(false), traceSeconds(DEFAULT_TRACE_SECONDS), traceFile(DEFAULT_TRACE_FILE), capturing(false), captureResampler(nullptr), starved(false), underrunCounted(false) {
+    auto constructionStart = std::chrono::steady_clock::now();
+    setState(Buckey::Service::State::LOADING);
+    
     //Load the config file
     configFile = g_key_file_new();
     GError * error = NULL;
@@ -84,6 +93,41 @@ PyramidASRService::PyramidASRService() : Buckey::ASRService(PYRAMID_VERSION, "py
     }
     delete deviceName;
     
+    //Load in the sample rate the decoders run at from the config file 'samprate', it has to match the acoustic model
+    int rate = g_key_file_get_integer(configFile, "Default", "samprate", &error);
+    if(error != NULL) {
+        if(error->code != G_KEY_FILE_ERROR_KEY_NOT_FOUND) {
+            std::cerr << "Error while parsing samprate from the config file, assuming " << DEFAULT_SAMPLE_RATE << " Hz: " << error->message << std::endl;
+        }
+        g_error_free(error);
+        error = NULL;
+        rate = DEFAULT_SAMPLE_RATE;
+    }
+    else if(rate <= 0) {
+        std::cerr << "samprate must be greater than zero, assuming " << DEFAULT_SAMPLE_RATE << " Hz" << std::endl;
+        rate = DEFAULT_SAMPLE_RATE;
+    }
+    sampleRate = rate;
+    
+    //Load in the rate to open the audio device at from the config file 'device-rate', use the device's native rate to skip ALSA's plug resampler
+    int dr = g_key_file_get_integer(configFile, "Default", "device-rate", &error);
+    if(error != NULL) {
+        if(error->code != G_KEY_FILE_ERROR_KEY_NOT_FOUND) {
+            std::cerr << "Error while parsing device-rate from the config file, assuming " << sampleRate << " Hz: " << error->message << std::endl;
+        }
+        g_error_free(error);
+        error = NULL;
+        dr = sampleRate;
+    }
+    else if(dr <= 0) {
+        std::cerr << "device-rate must be greater than zero, assuming " << sampleRate << " Hz" << std::endl;
+        dr = sampleRate;
+    }
+    deviceRate = dr;
+    if(deviceRate != sampleRate) {
+        captureResampler = new AudioResampler(deviceRate, sampleRate);
+    }
+    
     //Load in the number of decoders from the config file 'decoder-count'
     unsigned short defaultMaxDecoders = 2;
     int m = g_key_file_get_integer(configFile, "Default", "decoder-count", &error);
@@ -102,33 +146,332 @@ PyramidASRService::PyramidASRService() : Buckey::ASRService(PYRAMID_VERSION, "py
     else {
         maxDecoders = m;
     }
+    
+    //Load in the size of the audio capture ring from the config file 'audio-buffer-blocks'
+    int b = g_key_file_get_integer(configFile, "Default", "audio-buffer-blocks", &error);
+    if(error != NULL) {
+        if(error->code != G_KEY_FILE_ERROR_KEY_NOT_FOUND) {
+            std::cerr << "Error while parsing audio-buffer-blocks from the config file, assuming " << DEFAULT_AUDIO_BUFFER_BLOCKS << " blocks: " << error->message << std::endl;
+        }
+        g_error_free(error);
+        error = NULL;
+        b = DEFAULT_AUDIO_BUFFER_BLOCKS;
+    }
+    else if(b <= 0) {
+        std::cerr << "audio-buffer-blocks must be greater than zero, assuming " << DEFAULT_AUDIO_BUFFER_BLOCKS << " blocks" << std::endl;
+        b = DEFAULT_AUDIO_BUFFER_BLOCKS;
+    }
+    audioBufferBlocks = b;
+    audioBuffer = new AudioRingBuffer(audioBufferBlocks);
+    
+    //Load in the number of compiled searches each decoder keeps resident from the config file 'search-cache-size'
+    int c = g_key_file_get_integer(configFile, "Default", "search-cache-size", &error);
+    if(error != NULL) {
+        if(error->code != G_KEY_FILE_ERROR_KEY_NOT_FOUND) {
+            std::cerr << "Error while parsing search-cache-size from the config file, assuming " << DEFAULT_SEARCH_CACHE_SIZE << " searches: " << error->message << std::endl;
+        }
+        g_error_free(error);
+        error = NULL;
+        c = DEFAULT_SEARCH_CACHE_SIZE;
+    }
+    else if(c <= 0) {
+        std::cerr << "search-cache-size must be greater than zero, assuming " << DEFAULT_SEARCH_CACHE_SIZE << " searches" << std::endl;
+        c = DEFAULT_SEARCH_CACHE_SIZE;
+    }
+    searchCacheSize = c;
+    
+    //Load in the most PartialHypothesis signals to send per second from the config file 'partial-hypothesis-rate', 0 turns them off
+    double r = g_key_file_get_double(configFile, "Default", "partial-hypothesis-rate", &error);
+    if(error != NULL) {
+        if(error->code != G_KEY_FILE_ERROR_KEY_NOT_FOUND) {
+            std::cerr << "Error while parsing partial-hypothesis-rate from the config file, assuming " << DEFAULT_PARTIAL_HYPOTHESIS_RATE << " per second: " << error->message << std::endl;
+        }
+        g_error_free(error);
+        error = NULL;
+        r = DEFAULT_PARTIAL_HYPOTHESIS_RATE;
+    }
+    else if(r < 0) {
+        std::cerr << "partial-hypothesis-rate can not be negative, assuming " << DEFAULT_PARTIAL_HYPOTHESIS_RATE << " per second" << std::endl;
+        r = DEFAULT_PARTIAL_HYPOTHESIS_RATE;
+    }
+    partialInterval = std::chrono::microseconds((r == 0) ? 0 : (long long) (1000000 / r));
+    
+    //Load in the detection threshold for the wake phrase from the config file 'keyword-threshold'
+    double t = g_key_file_get_double(configFile, "Default", "keyword-threshold", &error);
+    if(error != NULL) {
+        if(error->code != G_KEY_FILE_ERROR_KEY_NOT_FOUND) {
+            std::cerr << "Error while parsing keyword-threshold from the config file, assuming " << DEFAULT_KEYWORD_THRESHOLD << ": " << error->message << std::endl;
+        }
+        g_error_free(error);
+        error = NULL;
+        t = DEFAULT_KEYWORD_THRESHOLD;
+    }
+    keywordThreshold = t;
+    keywordHistory = new AudioHistory(KEYWORD_HISTORY_BLOCKS);
+    
+    //Load in the number of files to transcribe at once from the config file 'transcription-workers', 0 means one per core
+    int w = g_key_file_get_integer(configFile, "Default", "transcription-workers", &error);
+    if(error != NULL) {
+        if(error->code != G_KEY_FILE_ERROR_KEY_NOT_FOUND) {
+            std::cerr << "Error while parsing transcription-workers from the config file, assuming " << DEFAULT_TRANSCRIPTION_WORKERS << ": " << error->message << std::endl;
+        }
+        g_error_free(error);
+        error = NULL;
+        w = DEFAULT_TRANSCRIPTION_WORKERS;
+    }
+    else if(w < 0) {
+        std::cerr << "transcription-workers can not be negative, assuming " << DEFAULT_TRANSCRIPTION_WORKERS << std::endl;
+        w = DEFAULT_TRANSCRIPTION_WORKERS;
+    }
+    if(w == 0) {
+        w = std::thread::hardware_concurrency();
+        if(w == 0) {
+            w = 1;
+        }
+    }
+    transcriptionWorkerCount = w;
+    transcriptionQueueLimit = 2 * transcriptionWorkerCount; // Enough that a worker never waits on the next file to be queued
+    
+    searchConfiguration.generation = 0;
+    searchConfiguration.hmmPath = hmmPath;
+    searchConfiguration.dictPath = dictPath;
+    searchConfiguration.modeSelected = false;
+    searchConfiguration.mode = SphinxHelper::SearchMode::LM;
+    
+    //Load in the recording settings from the config file, 'record-audio' is off, continuous or utterance
+    char * recordMode = g_key_file_get_string(configFile, "Default", "record-audio", &error);
+    std::string recording = "off";
+    if(error != NULL) {
+        if(error->code != G_KEY_FILE_ERROR_KEY_NOT_FOUND) {
+            std::cerr << "Error while parsing record-audio from the config file, leaving it off: " << error->message << std::endl;
+        }
+        g_error_free(error);
+        error = NULL;
+    }
+    else {
+        recording = recordMode;
+        g_free(recordMode);
+    }
+    
+    char * recordDir = g_key_file_get_string(configFile, "Default", "record-directory", &error);
+    std::string recordDirectory = DEFAULT_RECORD_DIRECTORY;
+    if(error != NULL) {
+        if(error->code != G_KEY_FILE_ERROR_KEY_NOT_FOUND) {
+            std::cerr << "Error while parsing record-directory from the config file, assuming " << DEFAULT_RECORD_DIRECTORY << ": " << error->message << std::endl;
+        }
+        g_error_free(error);
+        error = NULL;
+    }
+    else {
+        recordDirectory = recordDir;
+        g_free(recordDir);
+    }
+    
+    int recordBlocks = g_key_file_get_integer(configFile, "Default", "record-buffer-blocks", &error);
+    if(error != NULL) {
+        if(error->code != G_KEY_FILE_ERROR_KEY_NOT_FOUND) {
+            std::cerr << "Error while parsing record-buffer-blocks from the config file, assuming " << DEFAULT_RECORD_BUFFER_BLOCKS << ": " << error->message << std::endl;
+        }
+        g_error_free(error);
+        error = NULL;
+        recordBlocks = DEFAULT_RECORD_BUFFER_BLOCKS;
+    }
+    else if(recordBlocks < 2) {
+        std::cerr << "record-buffer-blocks must be at least 2, assuming " << DEFAULT_RECORD_BUFFER_BLOCKS << std::endl;
+        recordBlocks = DEFAULT_RECORD_BUFFER_BLOCKS;
+    }
+    
+    if(recording == "continuous") {
+        recordCapture = true;
+        recorder = new AudioRecorder(recordDirectory, "capture", sampleRate, recordBlocks);
+    }
+    else if(recording == "utterance") {
+        recordUtterances = true;
+        recorder = new AudioRecorder(recordDirectory, "utterance", sampleRate, recordBlocks);
+    }
+    else if(recording != "off") {
+        std::cerr << "Unknown record-audio mode " << recording << ", leaving it off" << std::endl;
+    }
+    
+    //Load in the tracing settings from the config file, 'trace' turns it on
+    gboolean trace = g_key_file_get_boolean(configFile, "Default", "trace", &error);
+    if(error != NULL) {
+        if(error->code != G_KEY_FILE_ERROR_KEY_NOT_FOUND) {
+            std::cerr << "Error while parsing trace from the config file, leaving it off: " << error->message << std::endl;
+        }
+        g_error_free(error);
+        error = NULL;
+        trace = FALSE;
+    }
+    Tracer::setEnabled(trace);
+    
+    double ts = g_key_file_get_double(configFile, "Default", "trace-seconds", &error);
+    if(error != NULL) {
+        if(error->code != G_KEY_FILE_ERROR_KEY_NOT_FOUND) {
+            std::cerr << "Error while parsing trace-seconds from the config file, assuming " << DEFAULT_TRACE_SECONDS << " s: " << error->message << std::endl;
+        }
+        g_error_free(error);
+        error = NULL;
+    }
+    else if(ts <= 0) {
+        std::cerr << "trace-seconds must be positive, assuming " << DEFAULT_TRACE_SECONDS << " s" << std::endl;
+    }
+    else {
+        traceSeconds = ts;
+    }
+    
+    char * tf = g_key_file_get_string(configFile, "Default", "trace-file", &error);
+    if(error != NULL) {
+        if(error->code != G_KEY_FILE_ERROR_KEY_NOT_FOUND) {
+            std::cerr << "Error while parsing trace-file from the config file, assuming " << DEFAULT_TRACE_FILE << ": " << error->message << std::endl;
+        }
+        g_error_free(error);
+        error = NULL;
+    }
+    else {
+        traceFile = tf;
+        g_free(tf);
+    }
+    
+    //Load in the energy gate settings from the config file, 'energy-vad' turns it on
+    gboolean vad = g_key_file_get_boolean(configFile, "Default", "energy-vad", &error);
+    if(error != NULL) {
+        if(error->code != G_KEY_FILE_ERROR_KEY_NOT_FOUND) {
+            std::cerr << "Error while parsing energy-vad from the config file, leaving it off: " << error->message << std::endl;
+        }
+        g_error_free(error);
+        error = NULL;
+        vad = FALSE;
+    }
+    
+    double vadThreshold = g_key_file_get_double(configFile, "Default", "vad-threshold", &error);
+    if(error != NULL) {
+        if(error->code != G_KEY_FILE_ERROR_KEY_NOT_FOUND) {
+            std::cerr << "Error while parsing vad-threshold from the config file, assuming " << DEFAULT_VAD_THRESHOLD << " dBFS: " << error->message << std::endl;
+        }
+        g_error_free(error);
+        error = NULL;
+        vadThreshold = DEFAULT_VAD_THRESHOLD;
+    }
+    
+    int vadHangover = g_key_file_get_integer(configFile, "Default", "vad-hangover", &error);
+    if(error != NULL) {
+        if(error->code != G_KEY_FILE_ERROR_KEY_NOT_FOUND) {
+            std::cerr << "Error while parsing vad-hangover from the config file, assuming " << DEFAULT_VAD_HANGOVER << " ms: " << error->message << std::endl;
+        }
+        g_error_free(error);
+        error = NULL;
+        vadHangover = DEFAULT_VAD_HANGOVER;
+    }
+    else if(vadHangover < 0) {
+        std::cerr << "vad-hangover can not be negative, assuming " << DEFAULT_VAD_HANGOVER << " ms" << std::endl;
+        vadHangover = DEFAULT_VAD_HANGOVER;
+    }
+    
+    int vadPreroll = g_key_file_get_integer(configFile, "Default", "vad-preroll", &error);
+    if(error != NULL) {
+        if(error->code != G_KEY_FILE_ERROR_KEY_NOT_FOUND) {
+            std::cerr << "Error while parsing vad-preroll from the config file, assuming " << DEFAULT_VAD_PREROLL << " ms: " << error->message << std::endl;
+        }
+        g_error_free(error);
+        error = NULL;
+        vadPreroll = DEFAULT_VAD_PREROLL;
+    }
+    else if(vadPreroll < 0) {
+        std::cerr << "vad-preroll can not be negative, assuming " << DEFAULT_VAD_PREROLL << " ms" << std::endl;
+        vadPreroll = DEFAULT_VAD_PREROLL;
+    }
+    
+    if(vad) {
+        energyGate = new EnergyGate(vadThreshold, (unsigned int) vadHangover * sampleRate / 1000);
+    }
+    //Round the pre-roll up to whole blocks
+    preRoll = new AudioHistory((vadPreroll * sampleRate / 1000 + AUDIO_FRAME_SIZE - 1) / AUDIO_FRAME_SIZE);
 
     listeningMode = ListeningMode::CONTINUOUS;
     searchMode = SphinxHelper::SearchMode::LM;
     
-    //Create our decoders
-    for(unsigned short i = 0; i < maxDecoders; i++) {
-		SphinxDecoder * sd = new SphinxDecoder("base-lm", hmmPath, dictPath, DEFAULT_LOG_PATH);
-		decoders.push_back(sd);
+    configLoadTime = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - constructionStart);
+    
+    //Create our decoders in the background so the DBus thread is free while the pool warms up
+    decoders.resize(maxDecoders, nullptr);
+    decoderStartupTimes.resize(maxDecoders, std::chrono::microseconds(0));
+    startupThread = std::thread(bringUpDecoders, this);
+    updateThread = std::thread(updateWorker, this);
+	
+	for(unsigned int i = 0; i < transcriptionWorkerCount; i++) {
+	    transcriptionWorkers.push_back(std::thread(transcriptionWorker, this, i));
+	}
+	
+	//At most maxDecoders utterances can be waiting on their hypothesis at once, so that many workers is enough
+	for(unsigned short i = 0; i < maxDecoders; i++) {
+	    finalizeWorkers.push_back(std::thread(finalizationWorker, this));
 	}
-	syslog(LOG_DEBUG, "Created decoders");
 }
 
 PyramidASRService::~PyramidASRService() {
-    endLoop.store(true);
+    waitForDecoders();
+    requestLoopEnd();
     
     //Kill the recognition thread if it is running
     if(listening.load() || recognizerLoop.joinable()) {
 		recognizerLoop.join();
     }
     
-    for(std::thread & t : miscThreads) {
+    //Abandon any queued files, the ones being transcribed stop at their next block
+    endTranscription.store(true);
+    {
+        std::lock_guard<std::mutex> lock(transcriptionLock);
+    }
+    transcriptionAvailable.notify_all();
+    for(std::thread & t : transcriptionWorkers) {
+        t.join();
+    }
+    for(TranscriptionJob & job : transcriptionQueue) {
+        if(job.fd >= 0) {
+            close(job.fd);
+        }
+    }
+    
+    //Streams notice within STREAM_POLL_INTERVAL
+    endStreams.store(true);
+    streamLock.lock();
+    for(AudioStream * stream : streams) {
+        stream->thread.join();
+        delete stream;
+    }
+    streams.clear();
+    streamLock.unlock();
+    
+    finalizeLock.lock();
+    endFinalize = true;
+    finalizeLock.unlock();
+    finalizeAvailable.notify_all();
+    for(std::thread & t : finalizeWorkers) {
         t.join();
     }
     
+    updateLock.lock();
+    endUpdates = true;
+    updateLock.unlock();
+    updateCondition.notify_all();
+    {
+        std::lock_guard<std::mutex> lock(idleLock);
+    }
+    decoderAvailable.notify_all();
+    updateThread.join();
+    
     for(SphinxDecoder * sd : decoders) {
         delete sd;
     }
+    delete keywordDecoder;
+    
+    delete keywordHistory;
+    delete preRoll;
+    delete energyGate;
+    delete captureResampler;
+    delete recorder;
+    delete audioBuffer;
     
     g_key_file_free(configFile);
 }
@@ -136,278 +479,1369 @@ PyramidASRService::~PyramidASRService() {
 void PyramidASRService::continuousSpeechRecognition(PyramidASRService * sr) {    
 	syslog(LOG_DEBUG, "continuousSpeechRecognition started");
 	sr->listening.store(true);
-	sr->updateLock.lock();
 	//Buckey::logInfo("Decoder management thread started");
 	sr->endLoop.store(false);
     ad_rec_t *ad = nullptr; // Audio source
-
-    int16 adbuf[2048]; //buffer that audio frames are copied into
-    int32 frameCount = 0; // Number of frames read into the adbuf
+    AudioBlock * block = nullptr; // Block of captured audio currently being decoded
+    SphinxDecoder * sd = nullptr; // Decoder currently being fed audio
+    std::chrono::steady_clock::time_point speechEndedAt; // Used to measure how long it takes to pick up the next decoder
+    bool handoffPending = false;
+    std::string lastPartial; // Last partial hypothesis sent for the current utterance
+    bool awake = false; // Set once the wake phrase has been spotted until the utterance that follows it ends
+    std::chrono::steady_clock::time_point awakeAt;
+    std::chrono::steady_clock::time_point lastPartialAt;
 
     sr->inUtterance.store(false);
 
     sr->voiceDetected.store(false); // Reset this as its used to keep track of state
 
-    
-	syslog(LOG_DEBUG, "Opening audio device for recognition");
-    // TODO: Use ad_open_dev without pocketsphinx's terrible configuration functions
-    //if ((ad = ad_open_dev(NULL,(int) cmd_ln_float32_r(sr->decoders[0]->getConfig(),"-samprate"))) == NULL) {
-    if(sr->device == "default") {
-	    if ((ad = ad_open_sps(16000)) == NULL) { ///TODO: make samples per second configurable
-	            
-	            syslog(LOG_ERR, "Failed to open audio device default!");
-	            sr->listening.store(false);
-            	return;
-	    }
-	}
-	else if((ad = ad_open_dev(sr->device.c_str(), 1600)) == NULL) {///TODO: make samples per second configurable
-	    syslog(LOG_ERR, "Failed to open audio device %s", sr->device.c_str()); 
-        sr->listening.store(false);
-        return;
-    }
-
-    if (ad_start_rec(ad) < 0) {
-        syslog(LOG_ERR, "Failed to start recording!");
+    if((ad = startCapture(sr, true)) == nullptr) {
         sr->listening.store(false);
         return;
     }
-    
-    sr->currentDecoderIndex.store(0);
-    
-    syslog(LOG_DEBUG, "Starting up utterances");
-    // Start up all of the utterances
-    for(SphinxDecoder * sd : sr->decoders) {
-        if(!sd->isInUtterance()) {
-            sd->startUtterance();
-        }
-    }
-    syslog(LOG_DEBUG, "Done starting utterances");
-
-    while(sr->decoders[sr->currentDecoderIndex]->state == SphinxHelper::DecoderState::NOT_INITIALIZED) {
-		//Wait until the decoder is ready
-    }
 
     sr->listening.store(true);
     //sr->triggerEvents(ON_READY, new EventData());
     //Buckey::getInstance()->reply("Sphinx Speech Recognition Ready", ReplyType::CONSOLE);
     std::cout << "Sphinx Speech Recognition Ready" << std::endl;
-	sr->updateLock.unlock();
 
 	//sr->triggerEvents(ON_SERVICE_READY, new EventData());
 
     while(!sr->endLoop.load()) {
 
-        // Read from the audio buffer
 		if(sr->paused.load()) {
-			sr->decoderIndexLock.lock();
-			sr->decoders[sr->currentDecoderIndex]->endUtterance();
+			//Throw away what was heard so far and give the decoder back, every decoder in the pool stays warm while paused
+			if(sd != nullptr) {
+				sr->currentDecoder.store(nullptr);
+				sd->endUtterance();
+				sd->startUtterance();
+				sr->releaseDecoder(sd);
+				sd = nullptr;
+			}
+			handoffPending = false;
 			sr->inUtterance.store(false);
-			sr->decoders[sr->currentDecoderIndex]->startUtterance();
-			sr->decoderIndexLock.unlock();
-		}
-		while(sr->paused.load() && !sr->endLoop) {
-			//Wait until not paused, but continue reading frames so that we only read current frames when we resume recognition
-			frameCount = ad_read(ad, adbuf, AUDIO_FRAME_SIZE);
-		}
-		if(sr->endLoop) {
-			break;
+			sr->voiceDetected.store(false);
+			sr->preRoll->clear();
+			sr->keywordHistory->clear();
+			awake = false;
+			sr->waitWhilePaused();
+			continue;
 		}
 
-		frameCount = ad_read(ad, adbuf, AUDIO_FRAME_SIZE);
+        // Check to make sure our current decoder has not errored out
+        if(sd != nullptr && sd->getState() == SphinxHelper::DecoderState::ERROR) {
+            syslog(LOG_ERR, "Decoder is errored out! Trying next decoder...");
+            sr->currentDecoder.store(nullptr);
+            sr->releaseDecoder(sd); // Drops it from rotation
+            sd = nullptr;
+        }
 
-        if(frameCount < 0 ) {
+        // Pick up the next warm decoder after each utterance
+        if(sd == nullptr) {
+            sd = sr->acquireDecoder(sr->endLoop);
+            if(sd == nullptr) {
+                if(!sr->endLoop.load()) {
+                    syslog(LOG_ERR, "No more good decoders to use! Stopping speech recognition!");
+                }
+                break;
+            }
+            sr->currentDecoder.store(sd);
             
-            syslog(LOG_ERR, "Failed to read from audio device for sphinx recognizer!");
-            // TODO: Maybe fail a bit more gracefully
-            //sr->killThreads();
-            //exit(-1);
-            sr->listening.store(false);
-            return;
+            if(handoffPending) {
+                auto latency = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - speechEndedAt);
+                if(Tracer::isEnabled()) {
+                    Tracer::complete("decoder", "decoder-handoff", Tracer::now() - latency.count());
+                }
+                sr->idleLock.lock();
+                sr->handoffLastLatency = latency;
+                if(latency > sr->handoffMaxLatency) {
+                    sr->handoffMaxLatency = latency;
+                }
+                sr->idleLock.unlock();
+                handoffPending = false;
+            }
         }
 
-        // Check to make sure our current decoder has not errored out
-        if(sr->decoders[sr->currentDecoderIndex]->state == SphinxHelper::DecoderState::ERROR) {
-            syslog(LOG_ERR, "Decoder is errored out! Trying next decoder...");
-			bool found = false;
-			for(unsigned short i = sr->currentDecoderIndex; i < sr->maxDecoders - 1; i++) {
-				if(sr->decoders[sr->currentDecoderIndex]->isReady()) {
-					sr->currentDecoderIndex.store(sr->currentDecoderIndex + i);
-					found = true;
-					break;
-				}
-			}
-			if(!found) {
-				syslog(LOG_ERR, "No more good decoders to use! Stopping speech recognition!");
-				sr->listening.store(false);
-				return;
-			}
-		}
+		block = sr->waitForAudio();
 
-        // Process the frames
-        sr->voiceDetected.store(sr->decoders[sr->currentDecoderIndex]->processRawAudio(adbuf, frameCount));
+        if(block == nullptr) {
+            if(!sr->capturing.load()) {
+                syslog(LOG_ERR, "Failed to read from audio device for sphinx recognizer!");
+                // TODO: Maybe fail a bit more gracefully
+                break;
+            }
+            continue; // Nothing captured yet
+        }
+
+        // Nobody said anything after the wake phrase, throw away what the pool decoder heard and go back to waiting for it
+        if(awake && !sr->inUtterance && std::chrono::steady_clock::now() - awakeAt > std::chrono::milliseconds(KEYWORD_WAKE_TIMEOUT)) {
+            awake = false;
+            sd->endUtterance();
+            sd->startUtterance();
+        }
+        
+        if(sr->energyGate != nullptr && !sr->inUtterance && !sr->energyGate->process(block->samples, block->frameCount)) {
+            //Too quiet to be speech, keep it as pre-roll in case speech starts in the next block but do not decode it
+            sr->preRoll->push(*block);
+            sr->audioBuffer->commitRead();
+            sr->voiceDetected.store(false);
+            sr->vadSkippedBlocks++;
+        }
+        else {
+            //Decode whatever led up to this block first so the start of the speech is not clipped
+            for(unsigned int i = 0; i < sr->preRoll->size(); i++) {
+                sr->decodeBlock(&sr->preRoll->at(i), sd, awake, awakeAt);
+            }
+            sr->preRoll->clear();
+            sr->voiceDetected.store(sr->decodeBlock(block, sd, awake, awakeAt));
+            if(sr->recordUtterances && (sr->inUtterance || sr->voiceDetected)) {
+                sr->recorder->push(*block);
+            }
+            sr->audioBuffer->commitRead();
+        }
 
         // Silence to speech transition
         // Trigger onSpeechStart
         if(sr->voiceDetected && !sr->inUtterance) {
             syslog(LOG_DEBUG, "Silence to speech transition");
+            Tracer::instant("utterance", "utterance-start");
             //sr->triggerEvents(ON_START_SPEECH, new EventData());
             sr->inUtterance.store(true);
 			//b->playSoundEffect(SoundEffects::READY, false);
+			lastPartial.clear();
+        }
+        
+        //Nothing but an atomic load while nobody is listening for partial hypotheses
+        if(sr->inUtterance && sr->partialSubscribers.load() > 0) {
+            sr->updatePartialHypothesis(sd, lastPartial, lastPartialAt);
         }
 
         //Speech to silence transition
         //Trigger onSpeechEnd
         //And get hypothesis
         if(!sr->voiceDetected && sr->inUtterance) {
-            sr->decoderIndexLock.unlock();
             syslog(LOG_DEBUG, "Speech to silence transition");
+            Tracer::instant("utterance", "utterance-end");
             //sr->triggerEvents(ON_END_SPEECH, new EventData()); //TODO: Add event data
             sr->inUtterance.store(false);
-            sr->decoders[sr->currentDecoderIndex]->ready = false;
-            sr->miscThreads.push_back(std::thread(endAndGetHypothesis, sr, sr->decoders[sr->currentDecoderIndex]));
-	        sr->decoderIndexLock.unlock();
-
-            usleep(100); // TODO: Windows portability
-
-	        sr->decoderIndexLock.lock();
-            for(unsigned short i = 0; i < sr->maxDecoders; i++) {
-                if(sr->decoders[i]->isReady()) {
-                    sr->currentDecoderIndex.store(i);
-                }
+            if(sr->recordUtterances) {
+                sr->recorder->endSegment();
             }
-            sr->decoderIndexLock.unlock();
+            sd->ready = false;
+            sr->currentDecoder.store(nullptr);
+            sr->queueFinalization(sd);
+            sd = nullptr;
+            speechEndedAt = std::chrono::steady_clock::now();
+            handoffPending = true;
+            awake = false; // Back to waiting for the wake phrase
+        }
+        else if(!sr->inUtterance && sr->swapRequested.load() && sd->hasPendingUpdates()) {
+            //The rest of the pool has switched to the new configuration, give this decoder up for updating while nobody is speaking
+            sr->swapRequested.store(false);
+            sr->currentDecoder.store(nullptr);
+            sr->releaseDecoder(sd);
+            sd = nullptr;
         }
     }
 
-    //Close the device audio source
-    ad_close(ad);
+    //Return our decoder to the pool, anything it heard so far is thrown away
+    if(sd != nullptr) {
+        sr->currentDecoder.store(nullptr);
+        sd->endUtterance();
+        sd->startUtterance();
+        sr->releaseDecoder(sd);
+    }
+    sr->inUtterance.store(false);
 
+    stopCapture(sr, ad);
     sr->listening.store(false);
 }
 
-void PyramidASRService::pushToSpeakRecognition(PyramidASRService * sr) {
+ad_rec_t * PyramidASRService::startCapture(PyramidASRService * sr, bool suspendOnPause) {
+	syslog(LOG_DEBUG, "Opening audio device for recognition");
+	ad_rec_t * ad;
+    // TODO: Use ad_open_dev without pocketsphinx's terrible configuration functions
+    //if ((ad = ad_open_dev(NULL,(int) cmd_ln_float32_r(sr->decoders[0]->getConfig(),"-samprate"))) == NULL) {
+    if(sr->device == "default") {
+	    if ((ad = ad_open_sps(sr->deviceRate)) == NULL) {
+	            syslog(LOG_ERR, "Failed to open audio device default!");
+            	return nullptr;
+	    }
+	}
+	else if((ad = ad_open_dev(sr->device.c_str(), sr->deviceRate)) == NULL) {
+	    syslog(LOG_ERR, "Failed to open audio device %s", sr->device.c_str()); 
+        return nullptr;
+    }
 
+    if (ad_start_rec(ad) < 0) {
+        syslog(LOG_ERR, "Failed to start recording!");
+        ad_close(ad);
+        return nullptr;
+    }
+    
+    //Hand the device over to the capture thread, from here on the management thread only decodes what it captures
+    sr->audioBuffer->clear();
+    sr->preRoll->clear();
+    sr->keywordHistory->clear();
+    if(sr->captureResampler != nullptr) {
+        sr->captureResampler->reset();
+    }
+    sr->starved = false;
+    sr->captureSuspendsOnPause = suspendOnPause;
+    sr->capturing.store(true);
+    sr->captureThread = std::thread(audioCaptureLoop, sr, ad);
+    return ad;
 }
 
-/// Applies previous updates and also initializes decoders if there weren't already when this object was constructed.
-void PyramidASRService::applyUpdates() {
-	updateLock.lock();
-	syslog(LOG_DEBUG, "Starting to apply updates.");
-	auto start = std::chrono::high_resolution_clock::now();
-    if(isListening()) { // Decoders are in use so reload the ones not in use
-		syslog(LOG_DEBUG, "Attempting to update while recognizing...");
-		unsigned short k = decoders.size();
-		unsigned short decodersDone[k];
-		unsigned short decoderDoneCount = 0;
-		while(decoderDoneCount != decoders.size()) {
-			for(unsigned short i = 0; i < decoders.size(); i++) {
-				unsigned short * c = std::find(decodersDone, decodersDone+k, i);
-				if(c != decodersDone+k) {
-					// This one was already updated, let it go
-				}
-				else {
-					//Not updated yet
-					if(i == currentDecoderIndex) {
-						if(!inUtterance) {
-							if(decoderDoneCount > 0) {
-								decoderIndexLock.lock();
-								currentDecoderIndex.store(decodersDone[0]);
-								decoderIndexLock.unlock();
-							}
-						}
-					}
-					else {
-						if(decoders[i]->getState() == SphinxHelper::DecoderState::UTTERANCE_STARTED) {
-							decoders[i]->applyUpdateQueue();
-							decoders[i]->startUtterance();
-							decodersDone[decoderDoneCount] = i;
-							decoderDoneCount++;
-						}
-					}
-				}
-			}
-		}
+void PyramidASRService::stopCapture(PyramidASRService * sr, ad_rec_t * ad) {
+    //Stop the capture thread and close the device audio source
+    sr->capturing.store(false);
+    {
+        std::lock_guard<std::mutex> lock(sr->pauseLock);
     }
-    else { // Decoders are not in use so restart them all now
-    	syslog(LOG_DEBUG, "Applying updates while not recognizing...");
-    	syslog(LOG_DEBUG, "%i decoders to update", decoders.size());
-		for(unsigned short i = 0; i < decoders.size(); i++) {
-		    syslog(LOG_DEBUG, "applying update...");
-			decoders[i]->applyUpdateQueue();
-			syslog(LOG_DEBUG, "starting utterance...");
-			decoders[i]->startUtterance();
-
-			if(i == 0) { // Select the first decoder that we update so it is ready ASAP
-			    syslog(LOG_DEBUG, "locking decoderIndexLock...");
-				decoderIndexLock.lock();
-				syslog(LOG_DEBUG, "locked decoderIndexLock!");
-				currentDecoderIndex.store(0);
-				decoderIndexLock.unlock();
-			}
-		}
-
+    sr->pauseCondition.notify_all(); // In case it is parked
+    sr->captureThread.join();
+    if(sr->recordCapture) {
+        sr->recorder->endSegment(); // Every listening session gets a file of its own
     }
-    syslog(LOG_DEBUG, "Decoder updates applied.");
-    updateLock.unlock();
-    auto stop = std::chrono::high_resolution_clock::now();
-    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(stop - start);
-    std::cout << "Time to apply decoder update: " << duration.count() << std::endl;
+    ad_close(ad);
 }
 
-void PyramidASRService::startListening() {
-    syslog(LOG_DEBUG, "startListening Called");
-    if(listeningMode == ListeningMode::PUSH_TO_SPEAK) {
-        paused.store(false);     
+void PyramidASRService::audioCaptureLoop(PyramidASRService * sr, ad_rec_t * ad) {
+    syslog(LOG_DEBUG, "audioCaptureLoop started");
+    AudioBlock dropped; // Scratch block the device is drained into while the ring is full
+    //When resampling, read only as many device samples as fit into one block once converted
+    std::vector<int16> deviceSamples;
+    int32 deviceFrames = AUDIO_FRAME_SIZE;
+    if(sr->captureResampler != nullptr) {
+        deviceFrames = sr->captureResampler->getMaxInput(AUDIO_FRAME_SIZE);
+        deviceSamples.resize(deviceFrames);
     }
-    if(!isListening()) {
-        endLoop.store(false);
-        voiceDetected.store(false);
-        listening.store(true);
+    
+    bool resumed = false; // Set until the first block after a pause arrives
+    while(sr->capturing.load()) {
+        if(sr->captureSuspendsOnPause && sr->paused.load()) {
+            //Stop the device rather than read and throw away audio, then sleep until resumed
+            ad_stop_rec(ad);
+            if(sr->recordCapture) {
+                sr->recorder->endSegment();
+            }
+            std::unique_lock<std::mutex> lock(sr->pauseLock);
+            sr->captureParked = true;
+            sr->pauseCondition.notify_all();
+            sr->pauseCondition.wait(lock, [sr] { return !sr->paused.load() || !sr->capturing.load(); });
+            sr->captureParked = false;
+            lock.unlock();
+            if(!sr->capturing.load()) {
+                break;
+            }
+            
+            if(sr->captureResampler != nullptr) {
+                sr->captureResampler->reset();
+            }
+            if(ad_start_rec(ad) < 0) {
+                syslog(LOG_ERR, "Failed to restart recording after a pause!");
+                break;
+            }
+            resumed = true;
+            continue;
+        }
         
-        if(listeningMode == ListeningMode::CONTINUOUS) {
-            recognizerLoop = std::thread(continuousSpeechRecognition, this);
+        AudioBlock * block = sr->audioBuffer->beginWrite();
+        bool overrun = (block == nullptr);
+        if(overrun) { // Decoding has fallen behind real time, keep reading so the device does not overrun instead
+            block = &dropped;
         }
-        else if(listeningMode == ListeningMode::PUSH_TO_SPEAK) {
-            recognizerLoop = std::thread(pushToSpeakRecognition, this);
+        
+        if(sr->captureResampler == nullptr) {
+            block->frameCount = ad_read(ad, block->samples, AUDIO_FRAME_SIZE);
         }
         else {
-            ///TODO: Warn that the other listening behaviors are currently unimplemented        
+            int32 n = ad_read(ad, deviceSamples.data(), deviceFrames);
+            block->frameCount = (n <= 0) ? n : sr->captureResampler->process(deviceSamples.data(), n, block->samples);
         }
-    }
-    else {
-        if(listeningMode == ListeningMode::PUSH_TO_SPEAK) {
-            ///TODO: Emit unpaused signal here
-        }  
-    }
-}
-
-void PyramidASRService::stopListening() {
-    syslog(LOG_DEBUG, "stopListening called");
-    if(listening.load()) {
-        voiceDetected.store(false);
+        if(block->frameCount < 0) {
+            syslog(LOG_ERR, "Failed to read from audio device!");
+            break;
+        }
+        else if(block->frameCount == 0) {
+            usleep(AUDIO_POLL_INTERVAL); // TODO: Windows portability
+            continue;
+        }
+        block->capturedAt = std::chrono::steady_clock::now();
+        Tracer::instant("audio", "capture-block");
         
-        if(listeningMode == ListeningMode::PUSH_TO_SPEAK) {
-            paused.store(true);
-            ///TODO: Emit pause signal        
+        if(sr->recordCapture) {
+            sr->recorder->push(*block); // Only ever copies into memory, even when the ring is full
         }
-        else {  
-            endLoop.store(true);
-            listening.store(false);
-            recognizerLoop.join();
+        
+        if(resumed) {
+            resumed = false;
+            auto latency = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - sr->resumedAt);
+            sr->resumeLastLatency.store(latency.count());
+            if((uint64_t) latency.count() > sr->resumeMaxLatency.load()) {
+                sr->resumeMaxLatency.store(latency.count());
+            }
         }
-    }
-}
-
-void PyramidASRService::endAndGetHypothesis(PyramidASRService * sr, SphinxDecoder * sd) {
+        
+        if(overrun) {
+            sr->audioBuffer->recordOverrun();
+        }
+        else {
+            sr->audioBuffer->commitWrite();
+            {
+                std::lock_guard<std::mutex> lock(sr->audioLock);
+            }
+            sr->audioAvailable.notify_one();
+        }
+    }
+    
+    sr->capturing.store(false);
+    sr->audioAvailable.notify_one();
+    syslog(LOG_DEBUG, "audioCaptureLoop stopped");
+}
+
+void PyramidASRService::bringUpDecoders(PyramidASRService * sr) {
+    auto start = std::chrono::steady_clock::now();
+    
+    //Bring up decoder 0 on its own first so it is not competing with the rest for CPU and disk, this also leaves the model files in the page cache for the others
+    createDecoder(sr, 0);
+    sr->idleLock.lock();
+    sr->firstDecoderTime = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+    sr->idleLock.unlock();
+    
+    //Then the rest of the pool concurrently, one thread per core at most
+    std::atomic<unsigned short> nextIndex(1);
+    unsigned int workerCount = std::thread::hardware_concurrency();
+    if(workerCount == 0) {
+        workerCount = 1;
+    }
+    if(workerCount > (unsigned int) sr->maxDecoders - 1) {
+        workerCount = sr->maxDecoders - 1;
+    }
+    std::vector<std::thread> workers;
+    for(unsigned int i = 0; i < workerCount; i++) {
+        workers.push_back(std::thread([sr, &nextIndex] {
+            unsigned short index;
+            while((index = nextIndex.fetch_add(1)) < sr->maxDecoders) {
+                createDecoder(sr, index);
+            }
+        }));
+    }
+    for(std::thread & t : workers) {
+        t.join();
+    }
+    
+    sr->idleLock.lock();
+    sr->poolReadyTime = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+    bool ready = sr->readySignalled;
+    syslog(LOG_INFO, "Decoder pool ready: config %.1f ms, first decoder %.1f ms, full pool of %u %.1f ms, %ld kB resident",
+        sr->configLoadTime.count() / 1000.0, sr->firstDecoderTime.count() / 1000.0, sr->maxDecoders, sr->poolReadyTime.count() / 1000.0, getResidentMemory());
+    sr->idleLock.unlock();
+    
+    if(!ready) {
+        syslog(LOG_ERR, "None of the decoders could be initialized!");
+        sr->setState(Buckey::Service::State::ERROR);
+        sr->signalError("None of the decoders could be initialized");
+        sr->decoderAvailable.notify_all(); // Let a waiting management thread see that every decoder has errored out
+    }
+}
+
+void PyramidASRService::createDecoder(PyramidASRService * sr, unsigned short index) {
+    auto start = std::chrono::steady_clock::now();
+    sr->searchConfigurationLock.lock();
+    SearchConfiguration c = sr->searchConfiguration;
+    sr->searchConfigurationLock.unlock();
+    
+    SphinxDecoder * sd = new SphinxDecoder("base-lm", c.hmmPath, c.dictPath, DEFAULT_LOG_PATH, sr->sampleRate);
+    sd->setSearchCacheSize(sr->searchCacheSize);
+    applySearchConfiguration(sd, c, true); // Whatever clients asked for before the pool was up
+    sd->startUtterance(); // Start an utterance so it is warm when handed to the management thread
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+    
+    //Changes made while it was being set up are queued on it like on the rest of the pool, they are applied by the next applyUpdates
+    sr->searchConfigurationLock.lock();
+    if(sr->searchConfiguration.generation != c.generation) {
+        applySearchConfiguration(sd, sr->searchConfiguration, false);
+    }
+    sr->idleLock.lock();
+    sr->decoders[index] = sd;
+    sr->decoderStartupTimes[index] = duration;
+    bool firstReady = !sr->readySignalled && sd->getState() == SphinxHelper::DecoderState::UTTERANCE_STARTED;
+    if(firstReady) {
+        sr->readySignalled = true;
+    }
+    sr->idleLock.unlock();
+    sr->searchConfigurationLock.unlock();
+    
+    syslog(LOG_DEBUG, "Decoder %u initialized in %.1f ms", index, duration.count() / 1000.0);
+    sr->releaseDecoder(sd);
+    
+    if(firstReady) {
+        sr->setState(Buckey::Service::State::READY);
+    }
+}
+
+void PyramidASRService::waitForDecoders() {
+    std::lock_guard<std::mutex> lock(startupLock);
+    if(startupThread.joinable()) {
+        startupThread.join();
+    }
+}
+
+SphinxDecoder * PyramidASRService::acquireDecoder(std::atomic<bool> & cancel) {
+    std::unique_lock<std::mutex> lock(idleLock);
+    decoderAvailable.wait(lock, [this, &cancel] { return !idleDecoders.empty() || cancel.load() || allDecodersErrored(); });
+    if(idleDecoders.empty()) {
+        return nullptr;
+    }
+    SphinxDecoder * sd = idleDecoders.front();
+    idleDecoders.pop_front();
+    return sd;
+}
+
+void PyramidASRService::releaseDecoder(SphinxDecoder * sd) {
+    idleLock.lock();
+    if(sd->getState() != SphinxHelper::DecoderState::UTTERANCE_STARTED) {
+        syslog(LOG_ERR, "Decoder %s is not ready for another utterance, removing it from rotation!", sd->getName().c_str());
+    }
+    else if(applyingUpdates && sd->hasPendingUpdates()) {
+        updateBacklog.push_back(sd);
+    }
+    else {
+        idleDecoders.push_back(sd);
+    }
+    idleLock.unlock();
+    decoderAvailable.notify_all();
+}
+
+bool PyramidASRService::allDecodersErrored() {
+    for(SphinxDecoder * sd : decoders) {
+        if(sd == nullptr || sd->getState() != SphinxHelper::DecoderState::ERROR) { // Decoders still being brought up count as usable
+            return false;
+        }
+    }
+    return true;
+}
+
+unsigned short PyramidASRService::countStaleDecoders() {
+    unsigned short count = 0;
+    for(SphinxDecoder * sd : decoders) {
+        if(sd->getState() != SphinxHelper::DecoderState::ERROR && sd->hasPendingUpdates()) {
+            count++;
+        }
+    }
+    return count;
+}
+
+AudioBlock * PyramidASRService::waitForAudio() {
+    AudioBlock * block = audioBuffer->beginRead();
+    if(block == nullptr) {
+        //An empty ring is normal whenever decoding keeps up, only a device that stops delivering audio while capturing is an underrun
+        if(!starved) {
+            starved = true;
+            underrunCounted = false;
+            starvedSince = std::chrono::steady_clock::now();
+        }
+        std::unique_lock<std::mutex> lock(audioLock);
+        audioAvailable.wait_for(lock, std::chrono::milliseconds(AUDIO_WAIT_TIMEOUT), [this] {
+            return !audioBuffer->isEmpty() || !capturing.load() || endLoop.load() || pushToSpeakToggled.load();
+        });
+        lock.unlock();
+        block = audioBuffer->beginRead();
+        if(paused.load() || !capturing.load()) {
+            starved = false; // No audio is expected, start timing again once it is
+        }
+        else if(block == nullptr && !underrunCounted && std::chrono::steady_clock::now() - starvedSince > std::chrono::milliseconds(AUDIO_UNDERRUN_TIMEOUT)) {
+            audioBuffer->recordUnderrun();
+            underrunCounted = true;
+        }
+    }
+    if(block != nullptr) {
+        starved = false;
+        captureQueueLatency.recordSince(block->capturedAt);
+    }
+    return block;
+}
+
+void PyramidASRService::pushToSpeakRecognition(PyramidASRService * sr) {
+    syslog(LOG_DEBUG, "pushToSpeakRecognition started");
+    sr->endLoop.store(false);
+    sr->inUtterance.store(false);
+    sr->voiceDetected.store(false);
+    SphinxDecoder * sd = nullptr; // Warm decoder waiting for the button, or being fed audio while it is held
+    bool pressed = false;
+    std::string lastPartial;
+    std::chrono::steady_clock::time_point lastPartialAt;
+    
+    //The device stays open the whole time so there is always audio from just before the button went down
+    ad_rec_t * ad = startCapture(sr, false);
+    if(ad == nullptr) {
+        sr->listening.store(false);
+        return;
+    }
+    sr->listening.store(true);
+    std::cout << "Sphinx Speech Recognition Ready" << std::endl;
+    
+    while(!sr->endLoop.load()) {
+        if(sd == nullptr) {
+            sd = sr->acquireDecoder(sr->endLoop);
+            if(sd == nullptr) {
+                if(!sr->endLoop.load()) {
+                    syslog(LOG_ERR, "No more good decoders to use! Stopping speech recognition!");
+                }
+                break;
+            }
+            sr->currentDecoder.store(sd);
+        }
+        
+        sr->pushToSpeakToggled.store(false);
+        if(!pressed && !sr->paused.load()) {
+            //Button down, start the utterance with what was said just before so the first syllable is not lost
+            Tracer::instant("utterance", "utterance-start");
+            pressed = true;
+            sr->inUtterance.store(true);
+            lastPartial.clear();
+            for(unsigned int i = 0; i < sr->preRoll->size(); i++) {
+                sd->processRawAudio(sr->preRoll->at(i).samples, sr->preRoll->at(i).frameCount);
+                if(sr->recordUtterances) {
+                    sr->recorder->push(sr->preRoll->at(i));
+                }
+            }
+            sr->preRoll->clear();
+        }
+        else if(pressed && sr->paused.load()) {
+            //Button up, decode what was already captured and hand the utterance to the finalization pool without waiting on the device
+            Tracer::instant("utterance", "utterance-end");
+            AudioBlock * block;
+            while((block = sr->audioBuffer->beginRead()) != nullptr) {
+                sd->processRawAudio(block->samples, block->frameCount);
+                if(sr->recordUtterances) {
+                    sr->recorder->push(*block);
+                }
+                sr->audioBuffer->commitRead();
+            }
+            if(sr->recordUtterances) {
+                sr->recorder->endSegment();
+            }
+            pressed = false;
+            sr->inUtterance.store(false);
+            sr->voiceDetected.store(false);
+            sd->ready = false;
+            sr->currentDecoder.store(nullptr);
+            sr->queueFinalization(sd, sr->pushToSpeakReleasedAt);
+            sd = nullptr;
+            continue;
+        }
+        else if(!pressed && sr->swapRequested.load() && sd->hasPendingUpdates()) {
+            //Nothing has been fed to it yet, so it can be given up for updating straight away
+            sr->swapRequested.store(false);
+            sr->currentDecoder.store(nullptr);
+            sr->releaseDecoder(sd);
+            sd = nullptr;
+            continue;
+        }
+        
+        AudioBlock * block = sr->waitForAudio();
+        if(block == nullptr) {
+            if(!sr->capturing.load()) {
+                syslog(LOG_ERR, "Failed to read from audio device for sphinx recognizer!");
+                break;
+            }
+            continue; // Nothing captured yet, or the button changed
+        }
+        
+        if(pressed) {
+            TraceScope trace("audio", "decode-block");
+            uint64_t cpuStart = threadCPUTime();
+            auto decodeStart = std::chrono::steady_clock::now();
+            sr->voiceDetected.store(sd->processRawAudio(block->samples, block->frameCount));
+            sr->decodeBlockLatency.recordSince(decodeStart);
+            sr->decodeCPUTime += threadCPUTime() - cpuStart;
+            if(sr->recordUtterances) {
+                sr->recorder->push(*block);
+            }
+        }
+        else {
+            sr->preRoll->push(*block);
+        }
+        sr->audioBuffer->commitRead();
+        
+        if(pressed && sr->partialSubscribers.load() > 0) {
+            sr->updatePartialHypothesis(sd, lastPartial, lastPartialAt);
+        }
+    }
+    
+    //Return our decoder to the pool, anything it heard so far is thrown away
+    if(sd != nullptr) {
+        sr->currentDecoder.store(nullptr);
+        sd->endUtterance();
+        sd->startUtterance();
+        sr->releaseDecoder(sd);
+    }
+    sr->inUtterance.store(false);
+    
+    stopCapture(sr, ad);
+    sr->listening.store(false);
+}
+
+/// Requests that all queued updates be applied to every decoder. Returns immediately, the work is done by updateWorker
+/// and UpdatesApplied is emitted once every decoder has been updated.
+void PyramidASRService::applyUpdates() {
+    updateLock.lock();
+    updateRequested = true;
+    updateLock.unlock();
+    updateCondition.notify_one();
+}
+
+void PyramidASRService::updateWorker(PyramidASRService * sr) {
+    sr->waitForDecoders();
+    
+    std::unique_lock<std::mutex> updateGuard(sr->updateLock);
+    while(true) {
+        sr->updateCondition.wait(updateGuard, [sr] { return sr->updateRequested || sr->endUpdates; });
+        if(sr->endUpdates) {
+            break;
+        }
+        sr->updateRequested = false;
+        updateGuard.unlock();
+        
+        syslog(LOG_DEBUG, "Starting to apply updates.");
+        auto start = std::chrono::high_resolution_clock::now();
+        
+        //Build the shadow set: update idle decoders off to the side while the rest keep serving with the old configuration.
+        //The last idle decoder is always left alone so the management thread never runs dry while this is going on.
+        std::vector<SphinxDecoder *> shadow;
+        while(true) {
+            SphinxDecoder * sd = nullptr;
+            sr->idleLock.lock();
+            if(sr->idleDecoders.size() > 1) {
+                for(auto it = sr->idleDecoders.begin(); it != sr->idleDecoders.end(); it++) {
+                    if((*it)->hasPendingUpdates()) {
+                        sd = *it;
+                        sr->idleDecoders.erase(it);
+                        break;
+                    }
+                }
+            }
+            sr->idleLock.unlock();
+            if(sd == nullptr) {
+                break;
+            }
+            
+            if(updateDecoder(sd)) {
+                shadow.push_back(sd);
+            }
+        }
+        
+        //Switch the idle pool over to the shadow set in one step. Whatever is still stale, including the live decoder once its utterance ends, is
+        //routed to the update backlog by releaseDecoder from here on.
+        sr->idleLock.lock();
+        for(auto it = sr->idleDecoders.begin(); it != sr->idleDecoders.end();) {
+            if((*it)->hasPendingUpdates()) {
+                sr->updateBacklog.push_back(*it);
+                it = sr->idleDecoders.erase(it);
+            }
+            else {
+                it++;
+            }
+        }
+        sr->idleDecoders.insert(sr->idleDecoders.begin(), shadow.begin(), shadow.end());
+        sr->applyingUpdates = true;
+        sr->idleLock.unlock();
+        sr->decoderAvailable.notify_all();
+        
+        //Update the stragglers as they come back
+        std::unique_lock<std::mutex> lock(sr->idleLock);
+        while(true) {
+            //Ask the management thread to give up its decoder at the next silent block if it is still on the old configuration
+            SphinxDecoder * live = sr->currentDecoder.load();
+            if(live != nullptr && live->hasPendingUpdates()) {
+                sr->swapRequested.store(true);
+            }
+            
+            sr->decoderAvailable.wait(lock, [sr] { return !sr->updateBacklog.empty() || sr->countStaleDecoders() == 0 || sr->endUpdates; });
+            if(sr->updateBacklog.empty()) { // Every usable decoder is up to date, or we are shutting down
+                break;
+            }
+            SphinxDecoder * sd = sr->updateBacklog.front();
+            sr->updateBacklog.pop_front();
+            lock.unlock();
+            
+            bool ok = updateDecoder(sd);
+            
+            lock.lock();
+            if(ok) {
+                sr->idleDecoders.push_front(sd); // Updated decoders are used first
+            }
+            sr->decoderAvailable.notify_all();
+        }
+        sr->applyingUpdates = false;
+        sr->swapRequested.store(false);
+        lock.unlock();
+        
+        auto stop = std::chrono::high_resolution_clock::now();
+        auto duration = std::chrono::duration_cast<std::chrono::microseconds>(stop - start);
+        syslog(LOG_DEBUG, "Decoder updates applied.");
+        std::cout << "Time to apply decoder update: " << duration.count() / 1000 << std::endl;
+        if(Tracer::isEnabled()) {
+            Tracer::complete("update", "apply-updates", Tracer::now() - duration.count());
+        }
+        sr->updatesApplied.emit(duration.count() / 1000.0);
+        
+        updateGuard.lock();
+    }
+}
+
+bool PyramidASRService::updateDecoder(SphinxDecoder * sd) {
+    TraceScope trace("update", "update-decoder");
+    syslog(LOG_DEBUG, "applying update to %s...", sd->getName().c_str());
+    if(sd->isInUtterance()) {
+        sd->endUtterance();
+    }
+    sd->applyUpdateQueue();
+    sd->startUtterance();
+    
+    if(sd->getState() != SphinxHelper::DecoderState::UTTERANCE_STARTED) {
+        syslog(LOG_ERR, "Decoder %s failed to restart after applying updates, removing it from rotation!", sd->getName().c_str());
+        return false;
+    }
+    return true;
+}
+
+void PyramidASRService::startListening() {
+    syslog(LOG_DEBUG, "startListening Called");
+    if(listeningMode == ListeningMode::PUSH_TO_SPEAK) {
+        paused.store(false);
+        togglePushToSpeak();
+    }
+    else if(paused.load()) {
+        resumeListening();
+    }
+    if(!isListening()) {
+        endLoop.store(false);
+        voiceDetected.store(false);
+        listening.store(true);
+        
+        if(listeningMode == ListeningMode::CONTINUOUS) {
+            recognizerLoop = std::thread(continuousSpeechRecognition, this);
+        }
+        else if(listeningMode == ListeningMode::PUSH_TO_SPEAK) {
+            recognizerLoop = std::thread(pushToSpeakRecognition, this);
+        }
+        else {
+            ///TODO: Warn that the other listening behaviors are currently unimplemented        
+        }
+    }
+    else {
+        if(listeningMode == ListeningMode::PUSH_TO_SPEAK) {
+            ///TODO: Emit unpaused signal here
+        }  
+    }
+}
+
+void PyramidASRService::stopListening() {
+    syslog(LOG_DEBUG, "stopListening called");
+    if(listening.load()) {
+        voiceDetected.store(false);
+        
+        if(listeningMode == ListeningMode::PUSH_TO_SPEAK) {
+            pushToSpeakReleasedAt = std::chrono::steady_clock::now(); // Published to the management thread by the store to paused
+            paused.store(true);
+            togglePushToSpeak();
+            ///TODO: Emit pause signal        
+        }
+        else {  
+            requestLoopEnd();
+            listening.store(false);
+            recognizerLoop.join();
+        }
+    }
+}
+
+void PyramidASRService::pauseListening() {
+    syslog(LOG_DEBUG, "pauseListening called");
+    if(listeningMode == ListeningMode::PUSH_TO_SPEAK) {
+        stopListening();
+        return;
+    }
+    if(!paused.exchange(true)) {
+        pauseCount++;
+    }
+    //The management thread sees paused at its next block, which stops the capture thread too
+}
+
+void PyramidASRService::resumeListening() {
+    syslog(LOG_DEBUG, "resumeListening called");
+    if(listeningMode == ListeningMode::PUSH_TO_SPEAK) {
+        startListening();
+        return;
+    }
+    std::lock_guard<std::mutex> lock(pauseLock);
+    resumedAt = std::chrono::steady_clock::now();
+    paused.store(false);
+    pauseCondition.notify_all();
+}
+
+void PyramidASRService::waitWhilePaused() {
+    std::unique_lock<std::mutex> lock(pauseLock);
+    //Once the capture thread has stopped the device nothing new can arrive, so the ring can be emptied for a clean start on resume
+    pauseCondition.wait(lock, [this] { return captureParked || !paused.load() || !capturing.load() || endLoop.load(); });
+    audioBuffer->clear();
+    pauseCondition.wait(lock, [this] { return !paused.load() || !capturing.load() || endLoop.load(); });
+}
+
+void PyramidASRService::togglePushToSpeak() {
+    pushToSpeakToggled.store(true);
+    {
+        std::lock_guard<std::mutex> lock(audioLock);
+    }
+    audioAvailable.notify_all();
+}
+
+void PyramidASRService::endAndGetHypothesis(PyramidASRService * sr, SphinxDecoder * sd, std::chrono::steady_clock::time_point silenceAt) {
     sd->endUtterance();
+    sr->endUtteranceLatency.recordSince(silenceAt);
+    auto start = std::chrono::steady_clock::now();
     std::string hyp = sd->getHypothesis();
+    sr->hypothesisLatency.recordSince(start);
     if(hyp != "") { // Ignore false alarms
+        start = std::chrono::steady_clock::now();
         sr->hypothesisCallback(hyp);
+        sr->emitLatency.recordSince(start);
         syslog(LOG_DEBUG, "Got hypothesis: %s", hyp.c_str());
     }
     sd->startUtterance();
 }
 
+uint32_t PyramidASRService::transcribeFile(std::string path) {
+    uint32_t id = nextJobId++;
+    syslog(LOG_DEBUG, "Queued %s for transcription as job %u", path.c_str(), id);
+    transcriptionLock.lock();
+    transcriptionQueue.push_back({id, 0, path, -1}); // Single files skip ahead of the batches
+    transcriptionLock.unlock();
+    transcriptionAvailable.notify_one();
+    return id;
+}
+
+uint32_t PyramidASRService::transcribeFd(int fd) {
+    uint32_t id = nextJobId++;
+    std::string name = "memfd job " + std::to_string(id);
+    
+    //The audio is read straight out of the client's pages, so it must not be able to change them or cut them short under us
+    int seals = fcntl(fd, F_GET_SEALS);
+    if(seals < 0 || (seals & (F_SEAL_WRITE | F_SEAL_SHRINK)) != (F_SEAL_WRITE | F_SEAL_SHRINK)) {
+        syslog(LOG_WARNING, "Refusing to transcribe %s, the memfd is not sealed against writing and shrinking", name.c_str());
+        close(fd);
+        transcriptionFailed.emit(id, "The memfd must be sealed with F_SEAL_WRITE and F_SEAL_SHRINK");
+        return id;
+    }
+    
+    syslog(LOG_DEBUG, "Queued %s for transcription", name.c_str());
+    transcriptionLock.lock();
+    transcriptionQueue.push_back({id, 0, name, fd});
+    transcriptionLock.unlock();
+    transcriptionAvailable.notify_one();
+    return id;
+}
+
+uint32_t PyramidASRService::transcribeBatch(std::vector<std::string> paths) {
+    uint32_t id = nextJobId++;
+    syslog(LOG_DEBUG, "Queued %lu files for transcription as batch %u", (unsigned long) paths.size(), id);
+    if(paths.empty()) {
+        batchFinished.emit(id, 0, 0);
+        return id;
+    }
+    
+    transcriptionLock.lock();
+    TranscriptionBatch & batch = batches[id];
+    batch.paths = paths;
+    batch.nextFile = 0;
+    batch.completed = 0;
+    batch.audioTime = 0;
+    batch.startedAt = std::chrono::steady_clock::now();
+    refillTranscriptionQueue();
+    transcriptionLock.unlock();
+    transcriptionAvailable.notify_all();
+    return id;
+}
+
+void PyramidASRService::refillTranscriptionQueue() {
+    //Take one file from each batch in turn so a small batch is not stuck behind a big one
+    bool queued = true;
+    while(transcriptionQueue.size() < transcriptionQueueLimit && queued) {
+        queued = false;
+        for(auto & b : batches) {
+            if(transcriptionQueue.size() >= transcriptionQueueLimit) {
+                break;
+            }
+            TranscriptionBatch & batch = b.second;
+            if(batch.nextFile < batch.paths.size()) {
+                transcriptionQueue.push_back({nextJobId++, b.first, batch.paths[batch.nextFile], -1});
+                batch.nextFile++;
+                queued = true;
+            }
+        }
+    }
+}
+
+void PyramidASRService::finishBatchFile(uint32_t batchId, double audioTime) {
+    transcriptionLock.lock();
+    auto it = batches.find(batchId);
+    if(it == batches.end()) {
+        transcriptionLock.unlock();
+        return;
+    }
+    TranscriptionBatch & batch = it->second;
+    batch.completed++;
+    if(audioTime > 0) {
+        batch.audioTime += audioTime;
+    }
+    uint32_t completed = batch.completed;
+    uint32_t total = batch.paths.size();
+    double batchAudio = batch.audioTime;
+    double wallTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - batch.startedAt).count();
+    if(completed == total) {
+        batches.erase(it);
+    }
+    transcriptionLock.unlock();
+    
+    batchProgress.emit(batchId, completed, total);
+    if(completed == total) {
+        //Wall clock time over audio time, so this goes down as more workers share the batch
+        double rtf = (batchAudio > 0) ? wallTime / batchAudio : 0;
+        syslog(LOG_DEBUG, "Batch %u of %u files finished, %.1f s of audio at %.3fx real time", batchId, total, batchAudio, rtf);
+        batchFinished.emit(batchId, batchAudio, rtf);
+    }
+}
+
+void PyramidASRService::transcriptionWorker(PyramidASRService * sr, unsigned int index) {
+    sr->waitForDecoders(); // Stay out of the way of the pool while it comes up
+    
+    SphinxDecoder * sd = nullptr;
+    unsigned int generation = 0;
+    std::unique_lock<std::mutex> lock(sr->transcriptionLock);
+    while(true) {
+        auto hasWork = [sr] { return sr->endTranscription.load() || !sr->transcriptionQueue.empty(); };
+        if(sd == nullptr) {
+            sr->transcriptionAvailable.wait(lock, hasWork);
+        }
+        else if(!sr->transcriptionAvailable.wait_for(lock, std::chrono::seconds(TRANSCRIPTION_IDLE_TIMEOUT), hasWork)) {
+            //Nothing to do for a while, give the memory back
+            sr->activeTranscriptionDecoders--;
+            lock.unlock();
+            sr->retireDecoder(sd);
+            sd = nullptr;
+            lock.lock();
+            continue;
+        }
+        if(sr->endTranscription.load()) {
+            break;
+        }
+        TranscriptionJob job = sr->transcriptionQueue.front();
+        sr->transcriptionQueue.pop_front();
+        sr->refillTranscriptionQueue();
+        if(sd == nullptr) {
+            sr->activeTranscriptionDecoders++;
+        }
+        lock.unlock();
+        
+        //Decoders are rebuilt rather than updated in place when the configuration changed, batches are rarely run often enough for it to matter
+        sr->searchConfigurationLock.lock();
+        bool stale = sd != nullptr && generation != sr->searchConfiguration.generation;
+        sr->searchConfigurationLock.unlock();
+        if(stale) {
+            sr->retireDecoder(sd);
+            sd = nullptr;
+        }
+        if(sd == nullptr) {
+            sd = sr->createStandaloneDecoder("transcription-" + std::to_string(index), generation);
+        }
+        
+        if(job.batchId != 0) {
+            sr->batchFileStarted.emit(job.batchId, job.id, job.path);
+        }
+        double audioTime = -1;
+        if(sd->getState() != SphinxHelper::DecoderState::UTTERANCE_STARTED) {
+            sr->transcriptionFailed.emit(job.id, "Unable to create a decoder");
+        }
+        else {
+            audioTime = sr->transcribe(sd, job);
+        }
+        if(job.batchId != 0) {
+            sr->finishBatchFile(job.batchId, audioTime);
+        }
+        
+        lock.lock();
+        if(sd->getState() == SphinxHelper::DecoderState::ERROR) {
+            sr->activeTranscriptionDecoders--;
+            lock.unlock();
+            sr->retireDecoder(sd);
+            sd = nullptr;
+            lock.lock();
+        }
+    }
+    if(sd != nullptr) {
+        sr->activeTranscriptionDecoders--;
+    }
+    lock.unlock();
+    if(sd != nullptr) {
+        sr->retireDecoder(sd);
+    }
+}
+
+uint32_t PyramidASRService::attachAudioStream(int fd, uint32_t sampleRate) {
+    AudioStream * stream = new AudioStream();
+    stream->id = nextJobId++;
+    stream->fd = fd;
+    stream->sampleRate = (sampleRate == 0) ? this->sampleRate : sampleRate;
+    stream->finished.store(false);
+    syslog(LOG_DEBUG, "Attached audio stream %u at %u Hz", stream->id, stream->sampleRate);
+    
+    std::lock_guard<std::mutex> guard(streamLock);
+    reapStreams();
+    streamCount++;
+    streams.push_back(stream);
+    stream->thread = std::thread(streamWorker, this, stream);
+    return stream->id;
+}
+
+void PyramidASRService::reapStreams() {
+    for(auto it = streams.begin(); it != streams.end();) {
+        if((*it)->finished.load()) {
+            (*it)->thread.join();
+            delete *it;
+            it = streams.erase(it);
+        }
+        else {
+            it++;
+        }
+    }
+}
+
+void PyramidASRService::streamWorker(PyramidASRService * sr, AudioStream * stream) {
+    sr->waitForDecoders(); // Stay out of the way of the pool while it comes up
+    //The stream gets a decoder of its own like a transcription worker, borrowing one from the pool for as long as the client keeps the stream
+    //open would leave the live loop short and keep applyUpdates from ever finishing
+    unsigned int generation = 0;
+    SphinxDecoder * sd = sr->createStandaloneDecoder("stream-" + std::to_string(stream->id), generation);
+    
+    AudioResampler * resampler = nullptr;
+    if(stream->sampleRate != (unsigned int) sr->sampleRate) {
+        resampler = new AudioResampler(stream->sampleRate, sr->sampleRate);
+    }
+    int32 capacity = (resampler == nullptr) ? AUDIO_FRAME_SIZE : resampler->getMaxInput(AUDIO_FRAME_SIZE);
+    std::vector<int16> input(capacity);
+    char * bytes = (char *) input.data();
+    size_t have = 0; // Bytes in input, a sample can be split across two reads
+    AudioBlock block;
+    
+    uint64_t samples = 0;
+    uint64_t utterances = 0;
+    std::chrono::microseconds totalLatency(0);
+    std::chrono::microseconds maxLatency(0);
+    bool inSpeech = false;
+    
+    struct pollfd pfd;
+    pfd.fd = stream->fd;
+    pfd.events = POLLIN;
+    while(sd->getState() == SphinxHelper::DecoderState::UTTERANCE_STARTED && !sr->endStreams.load()) {
+        int ready = poll(&pfd, 1, STREAM_POLL_INTERVAL);
+        if(ready < 0 && errno != EINTR) {
+            syslog(LOG_ERR, "Unable to poll audio stream %u: %s", stream->id, strerror(errno));
+            break;
+        }
+        if(ready <= 0) {
+            continue;
+        }
+        
+        ssize_t got = read(stream->fd, bytes + have, capacity * sizeof(int16) - have);
+        if(got == 0) { // The client hung up
+            break;
+        }
+        if(got < 0) {
+            if(errno == EINTR || errno == EAGAIN) {
+                continue;
+            }
+            syslog(LOG_ERR, "Unable to read audio stream %u: %s", stream->id, strerror(errno));
+            break;
+        }
+        auto receivedAt = std::chrono::steady_clock::now();
+        have += got;
+        int32 n = have / sizeof(int16);
+        if(n == 0) {
+            continue;
+        }
+        samples += n;
+        
+        int16 * pcm = input.data();
+        if(resampler != nullptr) {
+            n = resampler->process(input.data(), n, block.samples);
+            pcm = block.samples;
+        }
+        bool speech = sd->processRawAudio(pcm, n);
+        //Only carry a split sample over once it is decoded, without a resampler pcm is the start of input itself
+        if(have & 1) {
+            bytes[0] = bytes[have - 1];
+        }
+        have &= 1;
+        
+        //Split the stream into utterances the same way live audio is
+        if(speech) {
+            inSpeech = true;
+        }
+        else if(inSpeech) {
+            inSpeech = false;
+            sd->endUtterance();
+            std::string hyp = sd->getHypothesis();
+            //Pick up configuration changes between utterances, searches the decoder has already built come from its cache
+            sr->searchConfigurationLock.lock();
+            bool stale = generation != sr->searchConfiguration.generation;
+            SearchConfiguration c = sr->searchConfiguration;
+            sr->searchConfigurationLock.unlock();
+            if(stale) {
+                generation = c.generation;
+                applySearchConfiguration(sd, c, true);
+            }
+            sd->startUtterance();
+            if(sd->getState() == SphinxHelper::DecoderState::ERROR) {
+                break;
+            }
+            if(hyp != "") {
+                auto latency = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - receivedAt);
+                utterances++;
+                totalLatency += latency;
+                maxLatency = std::max(maxLatency, latency);
+                sr->streamHypothesis.emit(stream->id, hyp, latency.count() / 1000.0);
+            }
+        }
+    }
+    
+    if(sd->getState() == SphinxHelper::DecoderState::UTTERANCE_STARTED) {
+        //Whatever was said before the client hung up
+        if(inSpeech) {
+            auto endedAt = std::chrono::steady_clock::now();
+            sd->endUtterance();
+            std::string hyp = sd->getHypothesis();
+            if(hyp != "") {
+                auto latency = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - endedAt);
+                utterances++;
+                totalLatency += latency;
+                maxLatency = std::max(maxLatency, latency);
+                sr->streamHypothesis.emit(stream->id, hyp, latency.count() / 1000.0);
+            }
+        }
+    }
+    else {
+        syslog(LOG_ERR, "Unable to decode audio stream %u, its decoder errored out!", stream->id);
+    }
+    sr->retireDecoder(sd);
+    close(stream->fd);
+    delete resampler;
+    
+    double audioTime = (double) samples / stream->sampleRate;
+    double avgLatency = (utterances == 0) ? 0.0 : totalLatency.count() / 1000.0 / utterances;
+    sr->streamLock.lock();
+    sr->streamUtterances += utterances;
+    sr->streamTotalLatency += totalLatency;
+    sr->streamMaxLatency = std::max(sr->streamMaxLatency, maxLatency);
+    sr->streamLock.unlock();
+    syslog(LOG_DEBUG, "Audio stream %u closed after %.1f s of audio, hypothesis latency %.1f ms average", stream->id, audioTime, avgLatency);
+    sr->streamClosed.emit(stream->id, audioTime, avgLatency, maxLatency.count() / 1000.0);
+    stream->finished.store(true);
+}
+
+SphinxDecoder * PyramidASRService::createStandaloneDecoder(std::string name, unsigned int & generation) {
+    searchConfigurationLock.lock();
+    SearchConfiguration c = searchConfiguration;
+    searchConfigurationLock.unlock();
+    generation = c.generation;
+    
+    SphinxDecoder * sd = new SphinxDecoder(name, c.hmmPath, c.dictPath, DEFAULT_LOG_PATH, sampleRate);
+    sd->setSearchCacheSize(searchCacheSize);
+    accountingLock.lock();
+    standaloneDecoders.push_back(sd);
+    accountingLock.unlock();
+    
+    //Bring it up to date with what the pool has been told, reusing grammars that were already compiled
+    applySearchConfiguration(sd, c, true);
+    sd->startUtterance();
+    return sd;
+}
+
+void PyramidASRService::applySearchConfiguration(SphinxDecoder * sd, const SearchConfiguration & c, bool applyUpdate) {
+    if(sd->getState() == SphinxHelper::DecoderState::ERROR) {
+        return;
+    }
+    //The model and dictionary go first, switching either of them throws away every search
+    if(c.hmmPath != sd->getHMMPath()) {
+        sd->updateAcousticModel(c.hmmPath, applyUpdate);
+    }
+    if(c.dictPath != sd->getDictionaryPath()) {
+        sd->updateDictionary(c.dictPath, applyUpdate);
+    }
+    if(!c.logPath.empty()) {
+        sd->updateLoggingFile(c.logPath, applyUpdate);
+    }
+    if(!c.lmPath.empty()) {
+        sd->updateLM(c.lmPath, applyUpdate);
+    }
+    if(!c.grammar.empty()) {
+        sd->updateJSGFString(c.grammar, c.compiledGrammar, applyUpdate);
+    }
+    if(!c.jsgfPath.empty()) {
+        sd->updateJSGFFile(c.jsgfPath, c.compiledJSGFFile, applyUpdate);
+    }
+    if(c.modeSelected) {
+        sd->selectSearchMode(c.mode, applyUpdate);
+    }
+}
+
+double PyramidASRService::transcribe(SphinxDecoder * sd, TranscriptionJob & job) {
+    AudioFile file(sampleRate);
+    bool opened;
+    bool detailed = job.fd >= 0; // transcribeFd callers get the whole transcript with word timings in one signal
+    if(job.fd >= 0) {
+        opened = file.open(job.fd);
+        close(job.fd); // The mapping, if there is one, outlives the descriptor
+        job.fd = -1;
+    }
+    else {
+        opened = file.open(job.path);
+    }
+    if(!opened) {
+        syslog(LOG_ERR, "Unable to transcribe %s: %s", job.path.c_str(), file.getError().c_str());
+        transcriptionFailed.emit(job.id, file.getError());
+        return -1;
+    }
+    
+    auto start = std::chrono::steady_clock::now();
+    const int16 * samples;
+    bool inSpeech = false;
+    uint64_t fed = 0; // Samples decoded so far
+    uint64_t utteranceStart = 0; // Samples decoded before the current utterance was started
+    std::string transcript;
+    std::vector<WordTiming> words;
+    int32 n;
+    while((n = file.read(&samples, AUDIO_FRAME_SIZE)) > 0 && !endTranscription.load()) {
+        //Split the file into utterances the same way live audio is
+        bool speech = sd->processRawAudio(samples, n);
+        fed += n;
+        if(speech) {
+            inSpeech = true;
+        }
+        else if(inSpeech) {
+            inSpeech = false;
+            sd->endUtterance();
+            std::string hyp = sd->getHypothesis();
+            if(detailed) {
+                sd->getWordTimings(words, (double) utteranceStart / sampleRate);
+            }
+            sd->startUtterance();
+            utteranceStart = fed;
+            if(hyp != "") {
+                fileHypothesis.emit(job.id, hyp);
+                transcript += (transcript.empty() ? "" : " ") + hyp;
+            }
+        }
+    }
+    
+    //Whatever is left after the last pause
+    sd->endUtterance();
+    std::string hyp = sd->getHypothesis();
+    if(detailed) {
+        sd->getWordTimings(words, (double) utteranceStart / sampleRate);
+    }
+    sd->startUtterance();
+    if(n < 0) {
+        transcriptionFailed.emit(job.id, file.getError());
+        return -1;
+    }
+    if(endTranscription.load()) {
+        transcriptionFailed.emit(job.id, "Cancelled");
+        return -1;
+    }
+    if(hyp != "") {
+        fileHypothesis.emit(job.id, hyp);
+        transcript += (transcript.empty() ? "" : " ") + hyp;
+    }
+    
+    double decodeTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double audioTime = file.getDuration();
+    double rtf = (audioTime > 0) ? decodeTime / audioTime : 0;
+    syslog(LOG_DEBUG, "Transcribed %.1f s of audio from %s in %.2f s, %.3fx real time", audioTime, job.path.c_str(), decodeTime, rtf);
+    
+    transcriptionLock.lock();
+    transcriptionCount++;
+    transcriptionAudioTime += audioTime;
+    transcriptionDecodeTime += decodeTime;
+    transcriptionLastRTF = rtf;
+    transcriptionLock.unlock();
+    if(detailed) {
+        std::vector<std::string> wordNames;
+        std::vector<double> starts;
+        std::vector<double> ends;
+        for(WordTiming & w : words) {
+            wordNames.push_back(w.word);
+            starts.push_back(w.start);
+            ends.push_back(w.end);
+        }
+        transcriptionResult.emit(job.id, transcript, wordNames, starts, ends, decodeTime);
+    }
+    transcriptionFinished.emit(job.id, audioTime, rtf);
+    return audioTime;
+}
+
+void PyramidASRService::queueFinalization(SphinxDecoder * sd, std::chrono::steady_clock::time_point releasedAt) {
+    finalizeLock.lock();
+    finalizeQueue.push({sd, std::chrono::steady_clock::now(), releasedAt});
+    if(finalizeQueue.size() > finalizePeakDepth) {
+        finalizePeakDepth = finalizeQueue.size();
+    }
+    finalizeLock.unlock();
+    finalizeAvailable.notify_one();
+}
+
+void PyramidASRService::finalizationWorker(PyramidASRService * sr) {
+    std::unique_lock<std::mutex> lock(sr->finalizeLock);
+    while(true) {
+        sr->finalizeAvailable.wait(lock, [sr] { return sr->endFinalize || !sr->finalizeQueue.empty(); });
+        if(sr->finalizeQueue.empty()) { // Only reached once endFinalize is set and all work is done
+            break;
+        }
+        
+        FinalizeJob job = sr->finalizeQueue.front();
+        sr->finalizeQueue.pop();
+        lock.unlock();
+        
+        uint64_t cpuStart = threadCPUTime();
+        {
+            TraceScope trace("utterance", "finalize-utterance");
+            endAndGetHypothesis(sr, job.decoder, job.queuedAt);
+        }
+        sr->finalizeCPUTime += threadCPUTime() - cpuStart;
+        sr->releaseDecoder(job.decoder);
+        auto latency = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - job.queuedAt);
+        
+        lock.lock();
+        sr->finalizeCount++;
+        sr->finalizeTotalLatency += latency;
+        sr->finalizeLastLatency = latency;
+        if(latency > sr->finalizeMaxLatency) {
+            sr->finalizeMaxLatency = latency;
+        }
+        if(job.releasedAt != std::chrono::steady_clock::time_point()) {
+            auto releaseLatency = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - job.releasedAt);
+            sr->pushToSpeakCount++;
+            sr->pushToSpeakTotalLatency += releaseLatency;
+            sr->pushToSpeakLastLatency = releaseLatency;
+            if(releaseLatency > sr->pushToSpeakMaxLatency) {
+                sr->pushToSpeakMaxLatency = releaseLatency;
+            }
+        }
+    }
+}
+
 void PyramidASRService::setRecognitionMode(std::string mode) {
     //This changed the search mode
     
@@ -424,9 +1858,12 @@ void PyramidASRService::setRecognitionMode(std::string mode) {
         m = SphinxHelper::SearchMode::JSGF_STRING;    
     }
     
-    for(SphinxDecoder * sd : decoders) {
+    updateSearchConfiguration([m](SearchConfiguration & c) {
+        c.modeSelected = true;
+        c.mode = m;
+    }, [m](SphinxDecoder * sd) {
         sd->selectSearchMode(m);
-    }
+    });
     
     applyUpdates();
 }
@@ -444,7 +1881,7 @@ void PyramidASRService::setListeningMode(std::string m) {
     syslog(LOG_DEBUG, "setListeningBehavior called");
     if(listeningMode != mode) {
         if(listening.load()) { // If we were recognizing before this, continue recognition
-            endLoop.store(true); // Kill the old recognition loop      
+            requestLoopEnd(); // Kill the old recognition loop      
             recognizerLoop.join();    
         
             listeningMode = mode; // Switch modes
@@ -466,77 +1903,449 @@ void PyramidASRService::setListeningMode(std::string m) {
     }
 }
 
+void PyramidASRService::requestLoopEnd() {
+    endLoop.store(true);
+    
+    //Wake the management thread if it is waiting on audio, a decoder or a resume
+    {
+        std::lock_guard<std::mutex> lock(audioLock);
+    }
+    audioAvailable.notify_all();
+    {
+        std::lock_guard<std::mutex> lock(pauseLock);
+    }
+    pauseCondition.notify_all();
+    {
+        std::lock_guard<std::mutex> lock(idleLock);
+    }
+    decoderAvailable.notify_all();
+}
+
 bool PyramidASRService::isListening() {
     return listening.load();
 }
 
+void PyramidASRService::updatePartialHypothesis(SphinxDecoder * sd, std::string & last, std::chrono::steady_clock::time_point & lastAt) {
+    if(partialInterval.count() == 0) {
+        return;
+    }
+    auto now = std::chrono::steady_clock::now();
+    if(now - lastAt < partialInterval) {
+        return;
+    }
+    lastAt = now;
+    
+    std::string hyp = sd->getPartialHypothesis();
+    if(hyp.empty() || hyp == last) {
+        return;
+    }
+    last = hyp;
+    partialCount++;
+    partialHypothesis.emit(hyp);
+}
+
+void PyramidASRService::subscribePartialHypotheses() {
+    partialSubscribers++;
+}
+
+void PyramidASRService::unsubscribePartialHypotheses() {
+    unsigned int n = partialSubscribers.load();
+    while(n > 0 && !partialSubscribers.compare_exchange_weak(n, n - 1));
+}
+
+static void addLatencyStats(std::map<std::string, double> & stats, std::string stage, LatencyHistogram & h) {
+    stats["latency-" + stage + "-count"] = h.getCount();
+    stats["latency-" + stage + "-p50-ms"] = h.getPercentile(0.5) / 1000.0;
+    stats["latency-" + stage + "-p99-ms"] = h.getPercentile(0.99) / 1000.0;
+}
+
+bool PyramidASRService::dumpTrace(std::string path) {
+    if(!Tracer::isEnabled()) {
+        syslog(LOG_WARNING, "Asked to dump the trace, but tracing is turned off");
+        return false;
+    }
+    return Tracer::dump(path.empty() ? traceFile : path, traceSeconds);
+}
+
+static void addAccounting(std::map<std::string, double> & entry, const DecoderAccounting & a) {
+    static const char * stateNames[DECODER_STATE_COUNT] = {"utterance-started", "utterance-ending", "idle", "not-initialized", "error"};
+    entry["audio-s"] += a.audioSeconds;
+    entry["cpu-s"] += a.cpuSeconds;
+    entry["utterances"] += a.utterances;
+    entry["errors"] += a.errors;
+    for(unsigned int i = 0; i < DECODER_STATE_COUNT; i++) {
+        entry[std::string("state-") + stateNames[i] + "-s"] += a.stateSeconds[i];
+    }
+}
+
+void PyramidASRService::retireDecoder(SphinxDecoder * sd) {
+    accountingLock.lock();
+    standaloneDecoders.remove(sd);
+    addAccounting(retiredAccounting[sd->getName()], sd->takeAccounting());
+    accountingLock.unlock();
+    delete sd;
+}
+
+std::map<std::string, std::map<std::string, double>> PyramidASRService::takeDecoderAccounting() {
+    std::map<std::string, std::map<std::string, double>> accounting;
+    accountingLock.lock();
+    accounting.swap(retiredAccounting);
+    for(SphinxDecoder * sd : standaloneDecoders) {
+        addAccounting(accounting[sd->getName()], sd->takeAccounting());
+    }
+    accountingLock.unlock();
+    
+    //Pool decoders all share the same name, so they go by their place in the pool like in getStats
+    idleLock.lock();
+    for(unsigned short i = 0; i < decoders.size(); i++) {
+        if(decoders[i] != nullptr) {
+            addAccounting(accounting["decoder-" + std::to_string(i)], decoders[i]->takeAccounting());
+        }
+    }
+    idleLock.unlock();
+    
+    for(auto & d : accounting) {
+        std::map<std::string, double> & entry = d.second;
+        double total = 0;
+        for(auto & counter : entry) {
+            if(counter.first.compare(0, 6, "state-") == 0) {
+                total += counter.second;
+            }
+        }
+        entry["rtf"] = (entry["audio-s"] == 0) ? 0.0 : entry["cpu-s"] / entry["audio-s"];
+        //Warm pool decoders wait with an utterance started, so the share of CPU time says more about how busy one is than its state does
+        entry["utilization"] = (total == 0) ? 0.0 : entry["cpu-s"] / total;
+    }
+    return accounting;
+}
+
+std::map<std::string, double> PyramidASRService::getStats() {
+    std::map<std::string, double> stats;
+    stats["audio-buffer-capacity"] = audioBuffer->capacity();
+    stats["audio-buffer-depth"] = audioBuffer->size();
+    stats["audio-overruns"] = audioBuffer->getOverrunCount();
+    stats["audio-underruns"] = audioBuffer->getUnderrunCount();
+    stats["partial-hypothesis-subscribers"] = partialSubscribers.load();
+    stats["partial-hypothesis-count"] = partialCount.load();
+    stats["vad-skipped-blocks"] = vadSkippedBlocks.load();
+    
+    transcriptionLock.lock();
+    stats["transcription-queue-depth"] = transcriptionQueue.size();
+    stats["transcription-workers"] = transcriptionWorkerCount;
+    stats["transcription-active-decoders"] = activeTranscriptionDecoders;
+    stats["transcription-pending-batches"] = batches.size();
+    size_t pendingFiles = 0;
+    for(auto & b : batches) {
+        pendingFiles += b.second.paths.size() - b.second.nextFile;
+    }
+    stats["transcription-pending-files"] = pendingFiles;
+    stats["transcription-count"] = transcriptionCount;
+    stats["transcription-audio-s"] = transcriptionAudioTime;
+    stats["transcription-rtf-last"] = transcriptionLastRTF;
+    stats["transcription-rtf-avg"] = (transcriptionAudioTime == 0) ? 0.0 : transcriptionDecodeTime / transcriptionAudioTime;
+    transcriptionLock.unlock();
+    
+    streamLock.lock();
+    size_t activeStreams = 0;
+    for(AudioStream * stream : streams) {
+        if(!stream->finished.load()) {
+            activeStreams++;
+        }
+    }
+    stats["audio-streams-active"] = activeStreams;
+    stats["audio-stream-count"] = streamCount;
+    stats["stream-utterance-count"] = streamUtterances;
+    stats["stream-latency-avg-ms"] = (streamUtterances == 0) ? 0.0 : streamTotalLatency.count() / 1000.0 / streamUtterances;
+    stats["stream-latency-max-ms"] = streamMaxLatency.count() / 1000.0;
+    streamLock.unlock();
+    
+    stats["keyword-spotting"] = keywordSpotting.load() ? 1 : 0;
+    stats["keyword-hits"] = keywordHits.load();
+    stats["keyword-cpu-s"] = keywordCPUTime.load() / 1000000.0;
+    stats["decode-cpu-s"] = decodeCPUTime.load() / 1000000.0;
+    stats["finalize-cpu-s"] = finalizeCPUTime.load() / 1000000.0;
+    
+    finalizeLock.lock();
+    stats["finalize-workers"] = finalizeWorkers.size();
+    stats["finalize-queue-depth"] = finalizeQueue.size();
+    stats["finalize-queue-peak"] = finalizePeakDepth;
+    stats["finalize-count"] = finalizeCount;
+    stats["finalize-latency-last-ms"] = finalizeLastLatency.count() / 1000.0;
+    stats["finalize-latency-max-ms"] = finalizeMaxLatency.count() / 1000.0;
+    stats["finalize-latency-avg-ms"] = (finalizeCount == 0) ? 0.0 : finalizeTotalLatency.count() / 1000.0 / finalizeCount;
+    stats["recording-dropped-blocks"] = (recorder == nullptr) ? 0 : recorder->getDroppedBlocks();
+    stats["recording-written-bytes"] = (recorder == nullptr) ? 0 : recorder->getWrittenBytes();
+    stats["recording-files"] = (recorder == nullptr) ? 0 : recorder->getFileCount();
+    stats["pause-count"] = pauseCount.load();
+    stats["resume-latency-last-ms"] = resumeLastLatency.load() / 1000.0;
+    stats["resume-latency-max-ms"] = resumeMaxLatency.load() / 1000.0;
+    stats["push-to-speak-count"] = pushToSpeakCount;
+    stats["push-to-speak-latency-last-ms"] = pushToSpeakLastLatency.count() / 1000.0;
+    stats["push-to-speak-latency-max-ms"] = pushToSpeakMaxLatency.count() / 1000.0;
+    stats["push-to-speak-latency-avg-ms"] = (pushToSpeakCount == 0) ? 0.0 : pushToSpeakTotalLatency.count() / 1000.0 / pushToSpeakCount;
+    finalizeLock.unlock();
+    
+    addLatencyStats(stats, "capture-queue", captureQueueLatency);
+    addLatencyStats(stats, "decode-block", decodeBlockLatency);
+    addLatencyStats(stats, "end-utterance", endUtteranceLatency);
+    addLatencyStats(stats, "get-hypothesis", hypothesisLatency);
+    addLatencyStats(stats, "emit-hypothesis", emitLatency);
+    
+    stats["resident-memory-kb"] = getResidentMemory();
+    
+    idleLock.lock();
+    uint64_t cacheHits = 0, cacheMisses = 0, cacheEvictions = 0;
+    for(unsigned short i = 0; i < decoders.size(); i++) {
+        if(decoders[i] != nullptr) {
+            stats["startup-decoder-" + std::to_string(i) + "-ms"] = decoderStartupTimes[i].count() / 1000.0;
+            cacheHits += decoders[i]->getSearchCacheHits();
+            cacheMisses += decoders[i]->getSearchCacheMisses();
+            cacheEvictions += decoders[i]->getSearchCacheEvictions();
+        }
+    }
+    stats["search-cache-hits"] = cacheHits;
+    stats["search-cache-misses"] = cacheMisses;
+    stats["search-cache-evictions"] = cacheEvictions;
+    stats["startup-config-ms"] = configLoadTime.count() / 1000.0;
+    stats["startup-first-decoder-ms"] = firstDecoderTime.count() / 1000.0;
+    stats["startup-pool-ms"] = poolReadyTime.count() / 1000.0;
+    stats["idle-decoders"] = idleDecoders.size();
+    stats["decoder-handoff-last-us"] = handoffLastLatency.count();
+    stats["decoder-handoff-max-us"] = handoffMaxLatency.count();
+    idleLock.unlock();
+    return stats;
+}
+
 void PyramidASRService::setGrammar(std::string jsgf) {
     syslog(LOG_DEBUG, "setGrammar called");
-    for(SphinxDecoder * sd : decoders) {
-        sd->updateJSGFString(jsgf);
-    }
+    //Compile the grammar once in the background, every decoder installs the same FSG when its updates are applied.
+    //If no decoder is up yet to take the log base from, each one compiles the grammar itself as it comes up.
+    PendingGrammar grammar;
+    updateSearchConfiguration([&](SearchConfiguration & c) {
+        c.grammar = jsgf;
+        c.compiledGrammar = grammar;
+    }, [&](SphinxDecoder * sd) {
+        if(!grammar.valid()) {
+            grammar = CompiledGrammar::compileString(jsgf, sd->getLogBase(), sd->getLanguageWeight());
+        }
+        sd->updateJSGFString(jsgf, grammar);
+    });
 }
 
 void PyramidASRService::setLanguageModel(std::string lmpath) {
     syslog(LOG_DEBUG, "setLanguageModel called");
-    for(SphinxDecoder * sd : decoders) {
+    updateSearchConfiguration([&](SearchConfiguration & c) {
+        c.lmPath = lmpath;
+    }, [&](SphinxDecoder * sd) {
         sd->updateLM(lmpath);
-    }
+    });
 }
 
 void PyramidASRService::setKeyword(std::string keyword) {
-    //This modifies the search mode
-    ///TOOD: Currently unsupported, you should really put your keywords into the JSGF grammar
+    syslog(LOG_DEBUG, "setKeyword called");
+    std::lock_guard<std::mutex> guard(keywordLock);
+    this->keyword = keyword;
+    if(keyword.empty()) {
+        //Every frame goes straight to the decoder pool again
+        keywordSpotting.store(false);
+        return;
+    }
+    
+    if(keywordDecoder == nullptr && !createKeywordDecoder()) {
+        keywordSpotting.store(false);
+        return;
+    }
+    keywordDecoder->updateKeyword(keyword, keywordThreshold, true);
+    keywordDecoder->selectSearchMode(SphinxHelper::SearchMode::KEYWORD, true);
+    keywordDecoder->startUtterance();
+    if(keywordDecoder->getState() != SphinxHelper::DecoderState::UTTERANCE_STARTED) {
+        syslog(LOG_ERR, "Unable to spot keyword %s!", keyword.c_str());
+        signalError("Unable to spot keyword " + keyword);
+        keywordSpotting.store(false);
+        return;
+    }
+    keywordSpotting.store(true);
+}
+
+bool PyramidASRService::createKeywordDecoder() {
+    if(keywordDecoder != nullptr) {
+        retireDecoder(keywordDecoder);
+    }
+    keywordDecoder = new SphinxDecoder("keyword", hmmPath, dictPath, DEFAULT_LOG_PATH, sampleRate);
+    accountingLock.lock();
+    standaloneDecoders.push_back(keywordDecoder);
+    accountingLock.unlock();
+    if(keywordDecoder->getState() == SphinxHelper::DecoderState::ERROR) {
+        syslog(LOG_ERR, "Failed to create the keyword decoder!");
+        retireDecoder(keywordDecoder);
+        keywordDecoder = nullptr;
+        return false;
+    }
+    return true;
+}
+
+bool PyramidASRService::decodeBlock(AudioBlock * block, SphinxDecoder * sd, bool & awake, std::chrono::steady_clock::time_point & awakeAt) {
+    TraceScope trace("audio", "decode-block");
+    if(keywordSpotting.load() && !awake && !inUtterance) {
+        // Only the keyword decoder hears audio until it spots the wake phrase
+        if(!spotKeyword(block)) {
+            return false;
+        }
+        //Hand the pool decoder everything heard recently, the wake phrase included
+        awake = true;
+        awakeAt = std::chrono::steady_clock::now();
+        uint64_t cpuStart = threadCPUTime();
+        bool speech = replayKeywordHistory(sd);
+        decodeCPUTime += threadCPUTime() - cpuStart;
+        return speech;
+    }
+    
+    uint64_t cpuStart = threadCPUTime();
+    auto decodeStart = std::chrono::steady_clock::now();
+    bool speech = sd->processRawAudio(block->samples, block->frameCount);
+    decodeBlockLatency.recordSince(decodeStart);
+    decodeCPUTime += threadCPUTime() - cpuStart;
+    return speech;
+}
+
+bool PyramidASRService::spotKeyword(AudioBlock * block) {
+    keywordHistory->push(*block); // Remembered so it can be replayed to the pool decoder
+    
+    std::string hyp;
+    {
+        std::lock_guard<std::mutex> guard(keywordLock);
+        if(keywordDecoder == nullptr) {
+            return false;
+        }
+        uint64_t cpuStart = threadCPUTime();
+        keywordDecoder->processRawAudio(block->samples, block->frameCount);
+        hyp = keywordDecoder->getPartialHypothesis();
+        if(!hyp.empty()) {
+            //Restart so the keyphrase is not reported again
+            keywordDecoder->endUtterance();
+            keywordDecoder->startUtterance();
+            keywordHits++;
+        }
+        keywordCPUTime += threadCPUTime() - cpuStart;
+    }
+    
+    if(hyp.empty()) {
+        return false;
+    }
+    //Emitted without keywordLock so a slot calling setKeyword can not deadlock
+    syslog(LOG_DEBUG, "Spotted keyword %s", hyp.c_str());
+    keywordSpotted.emit(hyp);
+    return true;
+}
+
+bool PyramidASRService::replayKeywordHistory(SphinxDecoder * sd) {
+    bool inSpeech = false;
+    for(unsigned int i = 0; i < keywordHistory->size(); i++) {
+        AudioBlock & b = keywordHistory->at(i);
+        inSpeech = sd->processRawAudio(b.samples, b.frameCount);
+    }
+    keywordHistory->clear();
+    return inSpeech;
 }
 
 void PyramidASRService::updateDictionary(std::string pathToDictionary) {
-    for(SphinxDecoder * sd : decoders) {
+    dictPath = pathToDictionary;
+    updateSearchConfiguration([&](SearchConfiguration & c) {
+        c.dictPath = pathToDictionary;
+    }, [&](SphinxDecoder * sd) {
         sd->updateDictionary(pathToDictionary);
-    }
+    });
+    resetKeywordDecoder();
 }
 
 void PyramidASRService::updateAcousticModel(std::string pathToHMM) {
-    for(SphinxDecoder * sd : decoders) {
+    hmmPath = pathToHMM;
+    updateSearchConfiguration([&](SearchConfiguration & c) {
+        c.hmmPath = pathToHMM;
+    }, [&](SphinxDecoder * sd) {
         sd->updateAcousticModel(pathToHMM);
-    }
+    });
+    resetKeywordDecoder();
 }
 
-void PyramidASRService::updateJSGFPath(std::string pathToJSGF) {
+void PyramidASRService::updateSearchConfiguration(std::function<void(SearchConfiguration &)> func, std::function<void(SphinxDecoder *)> queue) {
+    std::lock_guard<std::mutex> guard(searchConfigurationLock);
     for(SphinxDecoder * sd : decoders) {
-        sd->updateJSGFFile(pathToJSGF);
+        if(sd != nullptr) { // The rest are still being brought up
+            queue(sd);
+        }
+    }
+    func(searchConfiguration);
+    searchConfiguration.generation++;
+}
+
+void PyramidASRService::resetKeywordDecoder() {
+    std::string k;
+    keywordLock.lock();
+    if(keywordDecoder != nullptr) {
+        retireDecoder(keywordDecoder);
+        keywordDecoder = nullptr;
+    }
+    k = keyword;
+    keywordLock.unlock();
+    
+    //The keyword decoder is rebuilt with the new model and dictionary straight away, unlike the pool it is not kept warm for swapping
+    if(!k.empty()) {
+        setKeyword(k);
     }
 }
 
+void PyramidASRService::updateJSGFPath(std::string pathToJSGF) {
+    PendingGrammar grammar;
+    updateSearchConfiguration([&](SearchConfiguration & c) {
+        c.jsgfPath = pathToJSGF;
+        c.compiledJSGFFile = grammar;
+    }, [&](SphinxDecoder * sd) {
+        if(!grammar.valid()) {
+            grammar = CompiledGrammar::compileFile(pathToJSGF, sd->getLogBase(), sd->getLanguageWeight());
+        }
+        sd->updateJSGFFile(pathToJSGF, grammar);
+    });
+}
+
 void PyramidASRService::updateLogPath(std::string pathToLog) {
-    for(SphinxDecoder * sd : decoders) {
+    updateSearchConfiguration([&](SearchConfiguration & c) {
+        c.logPath = pathToLog;
+    }, [&](SphinxDecoder * sd) {
         sd->updateLoggingFile(pathToLog);
+    });
+}
+
+SphinxDecoder * PyramidASRService::findUsableDecoder() {
+    std::lock_guard<std::mutex> guard(idleLock);
+    for(SphinxDecoder * sd : decoders) {
+        if(sd != nullptr && sd->getState() != SphinxHelper::DecoderState::ERROR && sd->getState() != SphinxHelper::DecoderState::NOT_INITIALIZED) {
+            return sd;
+        }
     }
+    return nullptr;
 }
 
 bool PyramidASRService::wordExists(std::string word) {
-    bool res = false;
-	bool found = false;
-	while(!found) {
-		for(unsigned short i = 0; i < maxDecoders - 1; i++) {
-			if(decoders[currentDecoderIndex]->isReady()) {
-				res = decoders[currentDecoderIndex]->wordExists(word);
-				found = true;
-				break;
-			}
-		}
-	}
-	return res;
+    SphinxDecoder * sd = findUsableDecoder();
+    if(sd != nullptr) {
+        return sd->wordExists(word);
+    }
+    syslog(LOG_WARNING, "Unable to look up word %s because no decoders are initialized!", word.c_str());
+    return false;
 }
 
 bool PyramidASRService::addWord(std::string word, std::string phones) {
-	for(unsigned short i = 0; i < maxDecoders - 1; i++) {
-		if(decoders[currentDecoderIndex]->getState() != SphinxHelper::DecoderState::ERROR && decoders[currentDecoderIndex]->getState() != SphinxHelper::DecoderState::NOT_INITIALIZED) {
-			decoders[currentDecoderIndex]->addWord(word, phones);
-			return true;
-		}
-		else {
-			syslog(LOG_WARNING, "Unable to add word %s to decoder because it was not initialized or errored out!", word.c_str());
-			return false;
-		}
-	}
+    keywordLock.lock();
+    if(keywordDecoder != nullptr) {
+        keywordDecoder->addWord(word, phones); // So the new word can be part of the wake phrase
+    }
+    keywordLock.unlock();
+    SphinxDecoder * sd = findUsableDecoder();
+    if(sd != nullptr) {
+        sd->addWord(word, phones);
+        return true;
+    }
+	syslog(LOG_WARNING, "Unable to add word %s to decoder because it was not initialized or errored out!", word.c_str());
+	return false;
 }
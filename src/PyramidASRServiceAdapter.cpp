@@ -1,6 +1,6 @@
 #include "PyramidASRServiceAdapter.h"
 
-    PyramidASRServiceAdapter::PyramidASRServiceAdapter(PyramidASRService * adaptee, std::string path) : Buckey::ASRServiceAdapter(adaptee, path) {
+    PyramidASRServiceAdapter::PyramidASRServiceAdapter(PyramidASRService * adaptee, std::string path) : Buckey::ASRServiceAdapter(adaptee, path), service(adaptee) {
     DBus::MethodBase::pointer temp_method;
     temp_method = this->create_method<void,std::string>("ca.l5.expandingdev.PyramidASR", "setGrammar",sigc::mem_fun(adaptee, &PyramidASRService::setGrammar));
     temp_method->set_arg_name(0, "jsgf");
@@ -8,6 +8,9 @@
     temp_method = this->create_method<void,std::string>("ca.l5.expandingdev.PyramidASR", "setLanguageModel",sigc::mem_fun(adaptee, &PyramidASRService::setLanguageModel));
     temp_method->set_arg_name(0, "path");
     
+    temp_method = this->create_method<void,std::string>("ca.l5.expandingdev.PyramidASR", "setKeyword",sigc::mem_fun(adaptee, &PyramidASRService::setKeyword));
+    temp_method->set_arg_name(0, "keyword");
+    
     temp_method = this->create_method<void,std::string>("ca.l5.expandingdev.PyramidASR", "setRecognitionMode",sigc::mem_fun(adaptee, &PyramidASRService::setRecognitionMode));
     temp_method->set_arg_name(0, "mode");
     
@@ -32,6 +35,130 @@
     temp_method = this->create_method<bool>("ca.l5.expandingdev.PyramidASR", "isListening",sigc::mem_fun(adaptee, &PyramidASRService::isListening));
     temp_method->set_arg_name(0, "listening");
     
+    temp_method = this->create_method<void>("ca.l5.expandingdev.PyramidASR", "pauseListening",sigc::mem_fun(adaptee, &PyramidASRService::pauseListening));
+    
+    temp_method = this->create_method<void>("ca.l5.expandingdev.PyramidASR", "resumeListening",sigc::mem_fun(adaptee, &PyramidASRService::resumeListening));
+    
+    temp_method = this->create_method<std::map<std::string,double>>("ca.l5.expandingdev.PyramidASR", "getStats",sigc::mem_fun(adaptee, &PyramidASRService::getStats));
+    temp_method->set_arg_name(0, "stats");
+    
+    temp_method = this->create_method<std::map<std::string,std::map<std::string,double>>>("ca.l5.expandingdev.PyramidASR", "takeDecoderAccounting",sigc::mem_fun(adaptee, &PyramidASRService::takeDecoderAccounting));
+    temp_method->set_arg_name(0, "accounting");
+    
+    temp_method = this->create_method<bool,std::string>("ca.l5.expandingdev.PyramidASR", "dumpTrace",sigc::mem_fun(adaptee, &PyramidASRService::dumpTrace));
+    temp_method->set_arg_name(0, "success");
+    temp_method->set_arg_name(1, "path");
+    
+    temp_method = this->create_method<uint32_t,std::string>("ca.l5.expandingdev.PyramidASR", "transcribeFile",sigc::mem_fun(adaptee, &PyramidASRService::transcribeFile));
+    temp_method->set_arg_name(0, "job-id");
+    temp_method->set_arg_name(1, "path");
+    
+    temp_method = this->create_method<uint32_t,DBus::FileDescriptor::pointer>("ca.l5.expandingdev.PyramidASR", "transcribeFd",sigc::mem_fun(*this, &PyramidASRServiceAdapter::transcribeFd));
+    temp_method->set_arg_name(0, "job-id");
+    temp_method->set_arg_name(1, "memfd");
+    
+    temp_method = this->create_method<uint32_t,std::vector<std::string>>("ca.l5.expandingdev.PyramidASR", "transcribeBatch",sigc::mem_fun(adaptee, &PyramidASRService::transcribeBatch));
+    temp_method->set_arg_name(0, "batch-id");
+    temp_method->set_arg_name(1, "paths");
+    
+    temp_method = this->create_method<uint32_t,DBus::FileDescriptor::pointer,uint32_t>("ca.l5.expandingdev.PyramidASR", "attachAudioStream",sigc::mem_fun(*this, &PyramidASRServiceAdapter::attachAudioStream));
+    temp_method->set_arg_name(0, "stream-id");
+    temp_method->set_arg_name(1, "fd");
+    temp_method->set_arg_name(2, "sample-rate");
+    
+    temp_method = this->create_method<void>("ca.l5.expandingdev.PyramidASR", "subscribePartialHypotheses",sigc::mem_fun(adaptee, &PyramidASRService::subscribePartialHypotheses));
+    
+    temp_method = this->create_method<void>("ca.l5.expandingdev.PyramidASR", "unsubscribePartialHypotheses",sigc::mem_fun(adaptee, &PyramidASRService::unsubscribePartialHypotheses));
+    
+    DBus::signal<void,double>::pointer updatesAppliedSignal = this->create_signal<void,double>("ca.l5.expandingdev.PyramidASR", "UpdatesApplied");
+    updatesAppliedSignal->set_arg_name(0, "duration-ms");
+    adaptee->updatesApplied.connect(updatesAppliedSignal->make_slot());
+    
+    DBus::signal<void,std::string>::pointer keywordSpottedSignal = this->create_signal<void,std::string>("ca.l5.expandingdev.PyramidASR", "KeywordSpotted");
+    keywordSpottedSignal->set_arg_name(0, "keyword");
+    adaptee->keywordSpotted.connect(keywordSpottedSignal->make_slot());
+    
+    DBus::signal<void,std::string>::pointer partialHypothesisSignal = this->create_signal<void,std::string>("ca.l5.expandingdev.PyramidASR", "PartialHypothesis");
+    partialHypothesisSignal->set_arg_name(0, "partial-match");
+    adaptee->partialHypothesis.connect(partialHypothesisSignal->make_slot());
+    
+    DBus::signal<void,uint32_t,std::string>::pointer fileHypothesisSignal = this->create_signal<void,uint32_t,std::string>("ca.l5.expandingdev.PyramidASR", "FileHypothesis");
+    fileHypothesisSignal->set_arg_name(0, "job-id");
+    fileHypothesisSignal->set_arg_name(1, "best-match");
+    adaptee->fileHypothesis.connect(fileHypothesisSignal->make_slot());
+    
+    DBus::signal<void,uint32_t,double,double>::pointer transcriptionFinishedSignal = this->create_signal<void,uint32_t,double,double>("ca.l5.expandingdev.PyramidASR", "TranscriptionFinished");
+    transcriptionFinishedSignal->set_arg_name(0, "job-id");
+    transcriptionFinishedSignal->set_arg_name(1, "audio-seconds");
+    transcriptionFinishedSignal->set_arg_name(2, "real-time-factor");
+    adaptee->transcriptionFinished.connect(transcriptionFinishedSignal->make_slot());
+    
+    DBus::signal<void,uint32_t,std::string>::pointer transcriptionFailedSignal = this->create_signal<void,uint32_t,std::string>("ca.l5.expandingdev.PyramidASR", "TranscriptionFailed");
+    transcriptionFailedSignal->set_arg_name(0, "job-id");
+    transcriptionFailedSignal->set_arg_name(1, "error");
+    adaptee->transcriptionFailed.connect(transcriptionFailedSignal->make_slot());
+    
+    DBus::signal<void,uint32_t,std::string,std::vector<std::string>,std::vector<double>,std::vector<double>,double>::pointer transcriptionResultSignal = this->create_signal<void,uint32_t,std::string,std::vector<std::string>,std::vector<double>,std::vector<double>,double>("ca.l5.expandingdev.PyramidASR", "TranscriptionResult");
+    transcriptionResultSignal->set_arg_name(0, "job-id");
+    transcriptionResultSignal->set_arg_name(1, "transcript");
+    transcriptionResultSignal->set_arg_name(2, "words");
+    transcriptionResultSignal->set_arg_name(3, "word-starts");
+    transcriptionResultSignal->set_arg_name(4, "word-ends");
+    transcriptionResultSignal->set_arg_name(5, "decode-seconds");
+    adaptee->transcriptionResult.connect(transcriptionResultSignal->make_slot());
+    
+    DBus::signal<void,uint32_t,uint32_t,std::string>::pointer batchFileStartedSignal = this->create_signal<void,uint32_t,uint32_t,std::string>("ca.l5.expandingdev.PyramidASR", "BatchFileStarted");
+    batchFileStartedSignal->set_arg_name(0, "batch-id");
+    batchFileStartedSignal->set_arg_name(1, "job-id");
+    batchFileStartedSignal->set_arg_name(2, "path");
+    adaptee->batchFileStarted.connect(batchFileStartedSignal->make_slot());
+    
+    DBus::signal<void,uint32_t,uint32_t,uint32_t>::pointer batchProgressSignal = this->create_signal<void,uint32_t,uint32_t,uint32_t>("ca.l5.expandingdev.PyramidASR", "BatchProgress");
+    batchProgressSignal->set_arg_name(0, "batch-id");
+    batchProgressSignal->set_arg_name(1, "completed");
+    batchProgressSignal->set_arg_name(2, "total");
+    adaptee->batchProgress.connect(batchProgressSignal->make_slot());
+    
+    DBus::signal<void,uint32_t,double,double>::pointer batchFinishedSignal = this->create_signal<void,uint32_t,double,double>("ca.l5.expandingdev.PyramidASR", "BatchFinished");
+    batchFinishedSignal->set_arg_name(0, "batch-id");
+    batchFinishedSignal->set_arg_name(1, "audio-seconds");
+    batchFinishedSignal->set_arg_name(2, "real-time-factor");
+    adaptee->batchFinished.connect(batchFinishedSignal->make_slot());
+    
+    DBus::signal<void,uint32_t,std::string,double>::pointer streamHypothesisSignal = this->create_signal<void,uint32_t,std::string,double>("ca.l5.expandingdev.PyramidASR", "StreamHypothesis");
+    streamHypothesisSignal->set_arg_name(0, "stream-id");
+    streamHypothesisSignal->set_arg_name(1, "best-match");
+    streamHypothesisSignal->set_arg_name(2, "latency-ms");
+    adaptee->streamHypothesis.connect(streamHypothesisSignal->make_slot());
+    
+    DBus::signal<void,uint32_t,double,double,double>::pointer streamClosedSignal = this->create_signal<void,uint32_t,double,double,double>("ca.l5.expandingdev.PyramidASR", "StreamClosed");
+    streamClosedSignal->set_arg_name(0, "stream-id");
+    streamClosedSignal->set_arg_name(1, "audio-seconds");
+    streamClosedSignal->set_arg_name(2, "latency-avg-ms");
+    streamClosedSignal->set_arg_name(3, "latency-max-ms");
+    adaptee->streamClosed.connect(streamClosedSignal->make_slot());
+    
+}
+
+uint32_t PyramidASRServiceAdapter::attachAudioStream(DBus::FileDescriptor::pointer fd, uint32_t sampleRate) {
+    //The descriptor libdbus hands over is already our own copy, the service closes it when the stream ends
+    return service->attachAudioStream(fd->getDescriptor(), sampleRate);
+}
+
+uint32_t PyramidASRServiceAdapter::transcribeFd(DBus::FileDescriptor::pointer fd) {
+    return service->transcribeFd(fd->getDescriptor());
+}
+
+DBus::HandlerResult PyramidASRServiceAdapter::handle_message(DBus::Connection::pointer connection, DBus::Message::const_pointer message) {
+    if(!Tracer::isEnabled() || message->type() != DBus::CALL_MESSAGE) {
+        return Buckey::ASRServiceAdapter::handle_message(connection, message);
+    }
+    DBus::CallMessage::const_pointer call = DBus::CallMessage::create(message);
+    uint64_t start = Tracer::now();
+    DBus::HandlerResult result = Buckey::ASRServiceAdapter::handle_message(connection, message);
+    const char * member = call->member();
+    Tracer::complete("dbus", (member == NULL) ? "unknown" : member, start);
+    return result;
 }
 
 std::shared_ptr<PyramidASRServiceAdapter> PyramidASRServiceAdapter::create(PyramidASRService * adaptee, std::string path){
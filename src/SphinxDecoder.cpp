@@ -1,15 +1,31 @@
 #include "SphinxDecoder.h"
+#include "ThreadCPUTime.h"
 #include <iostream>
+#include <sstream>
+#include <sys/stat.h>
+#include <time.h>
 #include "syslog.h"
 
-SphinxDecoder::SphinxDecoder(std::string decoderName, std::string pathToHMM, std::string pathToDictionary, std::string pathToLogFile) {
+SphinxDecoder::SphinxDecoder(std::string decoderName, std::string pathToHMM, std::string pathToDictionary, std::string pathToLogFile, int sampleRate) {
     name = decoderName;
+    this->sampleRate = sampleRate;
     state.store(SphinxHelper::DecoderState::NOT_INITIALIZED);
+    stateEnteredAt = std::chrono::steady_clock::now();
+    for(unsigned int i = 0; i < DECODER_STATE_COUNT; i++) {
+        stateTime[i] = std::chrono::microseconds(0);
+    }
+    audioSamples.store(0);
+    cpuTime.store(0);
+    utterances.store(0);
+    errors.store(0);
     ready = false;
-    jsgfFileSearchSet = false;
-	jsgfStringSearchSet = false;
-	lmSearchSet = false;
 	inUtterance = false;
+	recognitionMode = SphinxHelper::SearchMode::LM;
+	searchSelected = false;
+	searchCacheSize = DEFAULT_SEARCH_CACHE_SIZE;
+	searchCacheHits.store(0);
+	searchCacheMisses.store(0);
+	searchCacheEvictions.store(0);
     
     strncpy(hmmPath, pathToHMM.c_str(), 255);
     hmmPath[255] = '\0';
@@ -19,38 +35,58 @@ SphinxDecoder::SphinxDecoder(std::string decoderName, std::string pathToHMM, std
     
     dictionaryPath = pathToDictionary;
 	
-	config = cmd_ln_init(NULL, ps_args(), TRUE,
-				 "-hmm", hmmPath,
-				 "-dict", dictionaryPath.c_str(),
-				 "-logfn", logPath,
-					NULL);
-					
-	ps_default_search_args(config);
+	config = createConfig(hmmPath, dictionaryPath, logPath, sampleRate);
 	ps = ps_init(config);
+	logBase = (config == NULL) ? 1.0001 : cmd_ln_float32_r(config, "-logbase");
+	languageWeight = (config == NULL) ? 6.5 : cmd_ln_float32_r(config, "-lw");
 	if(ps == NULL) {
 	    ///TODO: Log error
 		//Buckey::logError("Unable to initialize PS Decoder!");
 		std::cerr << "Failed to initialize decoder!" << std::endl;
-		state = SphinxHelper::DecoderState::ERROR;
+		setState(SphinxHelper::DecoderState::ERROR);
 	}
 	#ifdef ENABLE_PS_STREAM
 	   ps_start_stream(ps);
 	#endif
 		
-    state = SphinxHelper::DecoderState::IDLE;
+    setState(SphinxHelper::DecoderState::IDLE);
 }
 
 SphinxDecoder::~SphinxDecoder()
 {
 	state = SphinxHelper::DecoderState::NOT_INITIALIZED;
+    CompiledGrammar::getReferenceLock().lock(); // Its searches may drop the last reference to a shared grammar
     ps_free(ps);
-    //cmd_ln_free_r(config);
+    CompiledGrammar::getReferenceLock().unlock();
+    if(config != NULL) {
+        cmd_ln_free_r(config);
+    }
+}
+
+cmd_ln_t * SphinxDecoder::createConfig(std::string pathToHMM, std::string pathToDictionary, std::string pathToLogFile, int sampleRate) {
+    std::string rate = std::to_string(sampleRate);
+    cmd_ln_t * c = cmd_ln_init(NULL, ps_args(), TRUE,
+                 "-hmm", pathToHMM.c_str(),
+                 "-dict", pathToDictionary.c_str(),
+                 "-logfn", pathToLogFile.c_str(),
+                 "-samprate", rate.c_str(),
+                    NULL);
+    if(c == NULL) {
+        syslog(LOG_ERR, "Failed to create decoder configuration for model %s!", pathToHMM.c_str());
+        return NULL;
+    }
+    ps_default_search_args(c);
+    return c;
 }
 
 std::string SphinxDecoder::getName() {
 	return name;
 }
 
+int SphinxDecoder::getSampleRate() {
+    return sampleRate;
+}
+
 std::string SphinxDecoder::getHypothesis() {
 	if(state == SphinxHelper::DecoderState::IDLE || state == SphinxHelper::DecoderState::NOT_INITIALIZED || state == SphinxHelper::DecoderState::ERROR) {
 		//Buckey::logWarn("Attempting to get hypothesis from decoder that is not ready! Check to make sure it is not errored out!");
@@ -58,8 +94,10 @@ std::string SphinxDecoder::getHypothesis() {
 		return "";
 	}
 
-	state = SphinxHelper::DecoderState::UTTERANCE_ENDING;
+	setState(SphinxHelper::DecoderState::UTTERANCE_ENDING);
+	uint64_t cpuStart = threadCPUTime();
     const char* hyp = ps_get_hyp(ps, NULL);
+    cpuTime.fetch_add(threadCPUTime() - cpuStart, std::memory_order_relaxed);
 
     if (hyp != NULL) {
     	return std::string(hyp);
@@ -69,15 +107,49 @@ std::string SphinxDecoder::getHypothesis() {
     }
 }
 
+std::string SphinxDecoder::getPartialHypothesis() {
+    if(state != SphinxHelper::DecoderState::UTTERANCE_STARTED) {
+        return "";
+    }
+    
+    uint64_t cpuStart = threadCPUTime();
+    const char* hyp = ps_get_hyp(ps, NULL);
+    cpuTime.fetch_add(threadCPUTime() - cpuStart, std::memory_order_relaxed);
+    return (hyp == NULL) ? "" : std::string(hyp);
+}
+
+void SphinxDecoder::getWordTimings(std::vector<WordTiming> & words, double offset) {
+    if(state != SphinxHelper::DecoderState::UTTERANCE_ENDING) {
+        return;
+    }
+    
+    double frameRate = cmd_ln_int32_r(config, "-frate");
+    for(ps_seg_t * seg = ps_seg_iter(ps); seg != NULL; seg = ps_seg_next(seg)) {
+        const char * word = ps_seg_word(seg);
+        //Sentence markers, silence and noise words are all bracketed
+        if(word == NULL || word[0] == '<' || word[0] == '[' || word[0] == '+') {
+            continue;
+        }
+        std::string w(word);
+        size_t alternate = w.find('('); // Alternate pronunciations come back as word(2)
+        if(alternate != std::string::npos && alternate > 0) {
+            w.erase(alternate);
+        }
+        int startFrame, endFrame;
+        ps_seg_frames(seg, &startFrame, &endFrame);
+        words.push_back({w, offset + startFrame / frameRate, offset + (endFrame + 1) / frameRate});
+    }
+}
+
 void SphinxDecoder::startUtterance() {
 	if(!(state == SphinxHelper::DecoderState::IDLE || state == SphinxHelper::DecoderState::UTTERANCE_ENDING)) {
 		syslog(LOG_WARNING, "Attempting to start decoder that is not in the IDLE state! Check to make sure it is initialized!");
 		return;
 	}
 
-	state = SphinxHelper::DecoderState::UTTERANCE_STARTED;
+	setState(SphinxHelper::DecoderState::UTTERANCE_STARTED);
     if(ps_start_utt(ps) < 0) {
-		state = SphinxHelper::DecoderState::ERROR;
+		setState(SphinxHelper::DecoderState::ERROR);
         syslog(LOG_ERR, "Error while starting utterance for PS Decoder!");
     }
     else {
@@ -91,15 +163,27 @@ void SphinxDecoder::endUtterance() {
 		syslog(LOG_WARNING, "Attempted to stop utterance of a decoder that did not start an utterance! Check that you started speech recognition!");
 		return;
 	}
-	state = SphinxHelper::DecoderState::UTTERANCE_ENDING;
+	setState(SphinxHelper::DecoderState::UTTERANCE_ENDING);
     ready = false;
     inUtterance = false;
-    ps_end_utt(ps);
+    uint64_t cpuStart = threadCPUTime();
+    if(ps_end_utt(ps) < 0) {
+        errors.fetch_add(1, std::memory_order_relaxed);
+    }
+    cpuTime.fetch_add(threadCPUTime() - cpuStart, std::memory_order_relaxed);
+    utterances.fetch_add(1, std::memory_order_relaxed);
 }
 
 /// Returns true if speech was detected in the last frame
-bool SphinxDecoder::processRawAudio(int16 adbuf[], int32 frameCount) {
-    ps_process_raw(ps, adbuf, frameCount, FALSE, FALSE);
+bool SphinxDecoder::processRawAudio(const int16 adbuf[], int32 frameCount) {
+    uint64_t cpuStart = threadCPUTime();
+    if(ps_process_raw(ps, adbuf, frameCount, FALSE, FALSE) < 0) {
+        errors.fetch_add(1, std::memory_order_relaxed);
+    }
+    else {
+        audioSamples.fetch_add(frameCount, std::memory_order_relaxed);
+    }
+    cpuTime.fetch_add(threadCPUTime() - cpuStart, std::memory_order_relaxed);
     return ps_get_in_speech(ps);
 }
 
@@ -134,8 +218,19 @@ void SphinxDecoder::updateAcousticModel(std::string pathToHMM, bool applyUpdate)
 void SphinxDecoder::_updateAcousticModel(SphinxDecoder * d, std::string pathToHMM) {
     syslog(LOG_DEBUG, "_updateAcousticModel called");
     strncpy(d->hmmPath, pathToHMM.c_str(), 255);
-    cmd_ln_set_str_r(d->config, "hmm", d->hmmPath);
-    ps_reinit(d->ps, NULL);
+    
+    //The decoder holds on to its old configuration until ps_reinit has switched it over to the new one
+    cmd_ln_t * oldConfig = d->config;
+    d->config = createConfig(d->hmmPath, d->dictionaryPath, d->logPath, d->sampleRate);
+    CompiledGrammar::getReferenceLock().lock();
+    ps_reinit(d->ps, d->config);
+    CompiledGrammar::getReferenceLock().unlock();
+    if(oldConfig != NULL) {
+        cmd_ln_free_r(oldConfig);
+    }
+    
+    //Reinitializing throws away all of the searches
+    _clearSearchCache(d);
 }
 
 void SphinxDecoder::updateDictionary(std::string pathToDict, bool applyUpdate) {
@@ -152,54 +247,113 @@ void SphinxDecoder::updateDictionary(std::string pathToDict, bool applyUpdate) {
 void SphinxDecoder::_updateDictionary(SphinxDecoder * d, std::string pathToDict) {
     syslog(LOG_DEBUG, "_updateDictionary called");
     d->dictionaryPath = pathToDict;
+    CompiledGrammar::getReferenceLock().lock(); // Every search is rebuilt, including around shared grammars
     ps_load_dict(d->ps, pathToDict.c_str(), NULL, NULL);
+    CompiledGrammar::getReferenceLock().unlock();
     ///TODO: Read the output of the above function call to check for errors
 }
 
 void SphinxDecoder::updateJSGFFile(std::string jsgfPath, bool applyUpdate) {  
+    updateJSGFFile(jsgfPath, PendingGrammar(), applyUpdate);
+}
+
+void SphinxDecoder::updateJSGFFile(std::string jsgfPath, PendingGrammar grammar, bool applyUpdate) {  
     if(applyUpdate) {
-        _updateJSGFFile(this, jsgfPath);
+        _updateJSGFFile(this, jsgfPath, grammar);
     }
     else {
         queueLock.lock();
-        updateQueue.push(std::bind(_updateJSGFFile, this, jsgfPath));
+        updateQueue.push(std::bind(_updateJSGFFile, this, jsgfPath, grammar));
         queueLock.unlock();
     }
 }
 
-void SphinxDecoder::_updateJSGFFile(SphinxDecoder * d, std::string pathToJSGF) {
+void SphinxDecoder::_updateJSGFFile(SphinxDecoder * d, std::string pathToJSGF, PendingGrammar grammar) {
     syslog(LOG_DEBUG, "_updateJSGFFile called");
-    if(d->jsgfFileSearchSet) {
-        ps_unset_search(d->ps, JSGF_FILE_SEARCH_NAME);
-    }
-    d->jsgfFileSearchSet = true;
 	d->jsgfPath = pathToJSGF;
-	ps_set_jsgf_file(d->ps, JSGF_FILE_SEARCH_NAME, pathToJSGF.c_str());
+	
+	//Key on the modification time too so that an edited grammar file gets recompiled
+	std::string source = pathToJSGF;
+	struct stat sb;
+	if(stat(pathToJSGF.c_str(), &sb) == 0) {
+	    source += ":" + std::to_string((long long) sb.st_mtime);
+	}
+	
+	std::string searchName;
+	if(!_findCachedSearch(d, JSGF_FILE_SEARCH_NAME, source, searchName)) {
+	    int res = grammar.valid() ? grammar.get()->install(d->ps, searchName) : ps_set_jsgf_file(d->ps, searchName.c_str(), pathToJSGF.c_str());
+	    if(res < 0) {
+	        syslog(LOG_ERR, "Failed to load JSGF grammar file %s!", pathToJSGF.c_str());
+	        return;
+	    }
+	    _cacheSearch(d, searchName, source);
+	}
+	d->jsgfFileSearchName = searchName;
+	_activateSearch(d, SphinxHelper::SearchMode::JSGF_FILE);
 }
 
 void SphinxDecoder::updateJSGFString(std::string jsgf, bool applyUpdate) {  
+    updateJSGFString(jsgf, PendingGrammar(), applyUpdate);
+}
+
+void SphinxDecoder::updateJSGFString(std::string jsgf, PendingGrammar grammar, bool applyUpdate) {  
     if(applyUpdate) {
-        _updateJSGFString(this, jsgf);
+        _updateJSGFString(this, jsgf, grammar);
     }
     else {
         queueLock.lock();
-        updateQueue.push(std::bind(_updateJSGFString, this, jsgf));
+        updateQueue.push(std::bind(_updateJSGFString, this, jsgf, grammar));
         queueLock.unlock();
     }
 }
 
-void SphinxDecoder::_updateJSGFString(SphinxDecoder * d, std::string jsgf) {
+void SphinxDecoder::_updateJSGFString(SphinxDecoder * d, std::string jsgf, PendingGrammar grammar) {
     syslog(LOG_DEBUG, "_updateJSGFString called"); 
     d->jsgfString = jsgf;
     if(d->inUtterance) {
         d->endUtterance();    
     }
-    if(d->jsgfStringSearchSet) {
-        ps_unset_search(d->ps, JSGF_STRING_SEARCH_NAME);
+    
+    std::string searchName;
+    if(!_findCachedSearch(d, JSGF_STRING_SEARCH_NAME, jsgf, searchName)) {
+        //Only wait on the shared grammar on a miss, a cached search is reused as is
+        int res = grammar.valid() ? grammar.get()->install(d->ps, searchName) : ps_set_jsgf_string(d->ps, searchName.c_str(), jsgf.c_str());
+        if(res < 0) {
+            ///TODO: Error out about invalid JSGF string over DBus
+            syslog(LOG_ERR, "Failed to compile JSGF string grammar!");
+            return;
+        }
+        _cacheSearch(d, searchName, jsgf);
+    }
+    d->jsgfStringSearchName = searchName;
+    _activateSearch(d, SphinxHelper::SearchMode::JSGF_STRING);
+}
+
+void SphinxDecoder::updateKeyword(std::string keyphrase, double threshold, bool applyUpdate) {  
+    if(applyUpdate) {
+        _updateKeyword(this, keyphrase, threshold);
+    }
+    else {
+        queueLock.lock();
+        updateQueue.push(std::bind(_updateKeyword, this, keyphrase, threshold));
+        queueLock.unlock();
     }
-    d->jsgfStringSearchSet = true;
-	ps_set_jsgf_string(d->ps, JSGF_STRING_SEARCH_NAME, jsgf.c_str());
-    ///TODO: Error out about invalid JSGF string
+}
+
+void SphinxDecoder::_updateKeyword(SphinxDecoder * d, std::string keyphrase, double threshold) {
+    syslog(LOG_DEBUG, "_updateKeyword called");
+    d->keyword = keyphrase;
+    if(d->inUtterance) {
+        d->endUtterance();    
+    }
+    
+    //The keyphrase search reads its threshold from the configuration when it is created
+    cmd_ln_set_float_r(d->config, "-kws_threshold", threshold);
+    if(ps_set_keyphrase(d->ps, KEYWORD_SEARCH_NAME, keyphrase.c_str()) < 0) {
+        syslog(LOG_ERR, "Failed to set keyphrase %s!", keyphrase.c_str());
+        return;
+    }
+    _activateSearch(d, SphinxHelper::SearchMode::KEYWORD);
 }
 
 void SphinxDecoder::updateLM(std::string lmPath, bool applyUpdate) {  
@@ -216,11 +370,17 @@ void SphinxDecoder::updateLM(std::string lmPath, bool applyUpdate) {
 void SphinxDecoder::_updateLM(SphinxDecoder * d, std::string pathToLM) {
     syslog(LOG_DEBUG, "_updateLM called");
 	d->lmPath = pathToLM;
-	if(d->lmSearchSet) {
-	    ps_unset_search(d->ps, LM_SEARCH_NAME);
+	
+	std::string searchName;
+	if(!_findCachedSearch(d, LM_SEARCH_NAME, pathToLM, searchName)) {
+	    if(ps_set_lm_file(d->ps, searchName.c_str(), pathToLM.c_str()) < 0) {
+	        syslog(LOG_ERR, "Failed to load language model %s!", pathToLM.c_str());
+	        return;
+	    }
+	    _cacheSearch(d, searchName, pathToLM);
 	}
-	d->lmSearchSet = true;
-	ps_set_lm_file(d->ps, LM_SEARCH_NAME, pathToLM.c_str());
+	d->lmSearchName = searchName;
+	_activateSearch(d, SphinxHelper::SearchMode::LM);
 }
 
 void SphinxDecoder::updateLoggingFile(std::string logPath, bool applyUpdate) {  
@@ -238,7 +398,10 @@ void SphinxDecoder::_updateLoggingFile(SphinxDecoder * d, std::string pathToLog)
     syslog(LOG_DEBUG, "_updateLoggingFile called");
 	strncpy(d->logPath, pathToLog.c_str(), 255);
 	cmd_ln_set_str_r(d->config, "logfn", d->logPath);
+	CompiledGrammar::getReferenceLock().lock();
 	ps_reinit(d->ps, NULL);
+	CompiledGrammar::getReferenceLock().unlock();
+	_clearSearchCache(d); // Reinitializing throws away all of the searches
 }
 
 void SphinxDecoder::selectSearchMode(SphinxHelper::SearchMode mode, bool applyUpdate) {
@@ -254,29 +417,91 @@ void SphinxDecoder::selectSearchMode(SphinxHelper::SearchMode mode, bool applyUp
 
 void SphinxDecoder::_selectSearchMode(SphinxDecoder * d, SphinxHelper::SearchMode mode) {
     d->recognitionMode = mode;
-	int res;
+    d->searchSelected = true;
+	int res = -1;
 	if(d->inUtterance) {
 	   d->endUtterance();
 	}
 	if(mode == SphinxHelper::SearchMode::JSGF_FILE) {
-	   res = ps_set_search(d->ps, JSGF_FILE_SEARCH_NAME);
+	   res = ps_set_search(d->ps, d->jsgfFileSearchName.c_str());
 	}
 	else if(mode == SphinxHelper::SearchMode::JSGF_STRING) {
-	   res = ps_set_search(d->ps, JSGF_STRING_SEARCH_NAME);
+	   res = ps_set_search(d->ps, d->jsgfStringSearchName.c_str());
 	}
 	else if(mode == SphinxHelper::SearchMode::LM) {
-	   res = ps_set_search(d->ps, LM_SEARCH_NAME);
+	   res = ps_set_search(d->ps, d->lmSearchName.c_str());
 	}
 	else if(mode == SphinxHelper::SearchMode::ALLPHONE) {
 	   res = ps_set_search(d->ps, ALLPHONE_SEARCH_NAME);
 	}
+	else if(mode == SphinxHelper::SearchMode::KEYWORD) {
+	   res = ps_set_search(d->ps, KEYWORD_SEARCH_NAME);
+	}
 	
 	if(res != 0) { ///TODO: Maybe better error reporting than this?
-        d->state.store(SphinxHelper::DecoderState::ERROR);
+        d->setState(SphinxHelper::DecoderState::ERROR);
         syslog(LOG_ERR, "Error while switching to new search mode!");
 	}
 }
 
+void SphinxDecoder::_activateSearch(SphinxDecoder * d, SphinxHelper::SearchMode mode) {
+    if(d->searchSelected && d->recognitionMode == mode) {
+        _selectSearchMode(d, mode);
+    }
+}
+
+bool SphinxDecoder::_findCachedSearch(SphinxDecoder * d, std::string prefix, std::string source, std::string & name) {
+    std::stringstream n;
+    n << prefix << "-" << std::hex << std::hash<std::string>()(source);
+    name = n.str();
+    
+    auto it = d->searchCacheIndex.find(name);
+    if(it != d->searchCacheIndex.end()) {
+        if(it->second->source == source) {
+            d->searchCache.splice(d->searchCache.begin(), d->searchCache, it->second);
+            d->searchCacheHits++;
+            return true;
+        }
+        //Hash collision, drop the old search here so compiling the new one under the same name never has to release a shared grammar
+        CompiledGrammar::getReferenceLock().lock();
+        ps_unset_search(d->ps, name.c_str());
+        CompiledGrammar::getReferenceLock().unlock();
+        d->searchCache.erase(it->second);
+        d->searchCacheIndex.erase(it);
+    }
+    d->searchCacheMisses++;
+    return false;
+}
+
+void SphinxDecoder::_cacheSearch(SphinxDecoder * d, std::string name, std::string source) {
+    d->searchCache.push_front({name, source});
+    d->searchCacheIndex[name] = d->searchCache.begin();
+    
+    //Evict from the least recently used end, but never a search that is active or selected for one of the search modes
+    const char * active = ps_get_search(d->ps);
+    auto it = d->searchCache.end();
+    while(d->searchCache.size() > d->searchCacheSize && it != d->searchCache.begin()) {
+        it--;
+        if((active != NULL && it->name == active) || it->name == d->jsgfFileSearchName || it->name == d->jsgfStringSearchName || it->name == d->lmSearchName || it->name == name) {
+            continue;
+        }
+        CompiledGrammar::getReferenceLock().lock();
+        ps_unset_search(d->ps, it->name.c_str());
+        CompiledGrammar::getReferenceLock().unlock();
+        d->searchCacheIndex.erase(it->name);
+        it = d->searchCache.erase(it);
+        d->searchCacheEvictions++;
+    }
+}
+
+void SphinxDecoder::_clearSearchCache(SphinxDecoder * d) {
+    d->searchCache.clear();
+    d->searchCacheIndex.clear();
+    d->jsgfFileSearchName = "";
+    d->jsgfStringSearchName = "";
+    d->lmSearchName = "";
+}
+
 void SphinxDecoder::applyUpdateQueue() {
     syslog(LOG_DEBUG, "applyUpdateQueue called");
     queueLock.lock();
@@ -298,6 +523,44 @@ const SphinxHelper::DecoderState SphinxDecoder::getState() {
 	return state.load();
 }
 
+void SphinxDecoder::setState(SphinxHelper::DecoderState newState) {
+    std::lock_guard<std::mutex> guard(accountingLock);
+    auto now = std::chrono::steady_clock::now();
+    stateTime[state.load()] += std::chrono::duration_cast<std::chrono::microseconds>(now - stateEnteredAt);
+    stateEnteredAt = now;
+    if(newState == SphinxHelper::DecoderState::ERROR && state.load() != SphinxHelper::DecoderState::ERROR) {
+        errors.fetch_add(1, std::memory_order_relaxed);
+    }
+    state.store(newState);
+}
+
+DecoderAccounting SphinxDecoder::takeAccounting() {
+    DecoderAccounting a;
+    a.audioSeconds = (double) audioSamples.exchange(0, std::memory_order_relaxed) / sampleRate;
+    a.cpuSeconds = cpuTime.exchange(0, std::memory_order_relaxed) / 1000000.0;
+    a.utterances = utterances.exchange(0, std::memory_order_relaxed);
+    a.errors = errors.exchange(0, std::memory_order_relaxed);
+    
+    std::lock_guard<std::mutex> guard(accountingLock);
+    //Charge the state it is in right now up to this moment, the rest goes to the next call
+    auto now = std::chrono::steady_clock::now();
+    stateTime[state.load()] += std::chrono::duration_cast<std::chrono::microseconds>(now - stateEnteredAt);
+    stateEnteredAt = now;
+    for(unsigned int i = 0; i < DECODER_STATE_COUNT; i++) {
+        a.stateSeconds[i] = stateTime[i].count() / 1000000.0;
+        stateTime[i] = std::chrono::microseconds(0);
+    }
+    return a;
+}
+
+/// Returns true if there are updates queued that have not been applied yet
+bool SphinxDecoder::hasPendingUpdates() {
+    queueLock.lock();
+    bool pending = !updateQueue.empty();
+    queueLock.unlock();
+    return pending;
+}
+
 std::string SphinxDecoder::getDictionaryPath() {
 	return dictionaryPath;
 }
@@ -314,10 +577,38 @@ std::string SphinxDecoder::getJSGFString() {
     return jsgfString;
 }
 
+std::string SphinxDecoder::getKeyword() {
+    return keyword;
+}
+
 char * SphinxDecoder::getHMMPath() {
 	return hmmPath;
 }
 
+void SphinxDecoder::setSearchCacheSize(unsigned int size) {
+    searchCacheSize = (size == 0) ? 1 : size;
+}
+
+uint64_t SphinxDecoder::getSearchCacheHits() {
+    return searchCacheHits.load();
+}
+
+uint64_t SphinxDecoder::getSearchCacheMisses() {
+    return searchCacheMisses.load();
+}
+
+uint64_t SphinxDecoder::getSearchCacheEvictions() {
+    return searchCacheEvictions.load();
+}
+
 char * SphinxDecoder::getLogPath() {
 	return logPath;
 }
+
+float32 SphinxDecoder::getLogBase() {
+    return logBase;
+}
+
+float32 SphinxDecoder::getLanguageWeight() {
+    return languageWeight;
+}
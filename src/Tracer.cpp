@@ -0,0 +1,126 @@
+#include "Tracer.h"
+
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <chrono>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "syslog.h"
+
+std::atomic<bool> Tracer::enabled(false);
+std::mutex Tracer::buffersLock;
+std::vector<Tracer::ThreadBuffer *> Tracer::buffers;
+std::vector<Tracer::ThreadBuffer *> Tracer::freeBuffers;
+thread_local Tracer::ThreadHandle Tracer::handle;
+
+Tracer::ThreadHandle::~ThreadHandle() {
+    if(buffer != nullptr) {
+        std::lock_guard<std::mutex> guard(buffersLock);
+        freeBuffers.push_back(buffer);
+    }
+}
+
+void Tracer::setEnabled(bool on) {
+    enabled.store(on);
+}
+
+uint64_t Tracer::now() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Tracer::recordInstant(const char * category, const char * name) {
+    record(category, name, 'i', now(), 0);
+}
+
+void Tracer::complete(const char * category, const char * name, uint64_t start) {
+    uint64_t end = now();
+    record(category, name, 'X', start, end - start);
+}
+
+Tracer::ThreadBuffer * Tracer::threadBuffer() {
+    if(handle.buffer == nullptr) {
+        std::lock_guard<std::mutex> guard(buffersLock);
+        if(!freeBuffers.empty()) {
+            handle.buffer = freeBuffers.back();
+            freeBuffers.pop_back();
+        }
+        else {
+            handle.buffer = new ThreadBuffer();
+            handle.buffer->written.store(0);
+            buffers.push_back(handle.buffer);
+        }
+        handle.tid = syscall(SYS_gettid);
+    }
+    return handle.buffer;
+}
+
+void Tracer::record(const char * category, const char * name, char phase, uint64_t start, uint64_t duration) {
+    ThreadBuffer * b = threadBuffer();
+    uint64_t index = b->written.load(std::memory_order_relaxed);
+    TraceEvent & e = b->events[index % TRACE_BUFFER_EVENTS];
+    strncpy(e.name, name, TRACE_NAME_LENGTH - 1);
+    e.name[TRACE_NAME_LENGTH - 1] = '\0';
+    e.category = category;
+    e.phase = phase;
+    e.tid = handle.tid;
+    e.start = start;
+    e.duration = duration;
+    b->written.store(index + 1, std::memory_order_release);
+}
+
+bool Tracer::dump(std::string path, double seconds) {
+    uint64_t since = now() - (uint64_t) (seconds * 1000000);
+    std::vector<TraceEvent> events;
+
+    buffersLock.lock();
+    for(ThreadBuffer * b : buffers) {
+        uint64_t end = b->written.load(std::memory_order_acquire);
+        uint64_t begin = (end > TRACE_BUFFER_EVENTS) ? end - TRACE_BUFFER_EVENTS : 0;
+        size_t first = events.size();
+        for(uint64_t i = begin; i < end; i++) {
+            events.push_back(b->events[i % TRACE_BUFFER_EVENTS]);
+        }
+        //The owning thread kept recording while the events were copied, drop any it may have overwritten in the meantime
+        uint64_t after = b->written.load(std::memory_order_acquire);
+        if(after + 1 > begin + TRACE_BUFFER_EVENTS) {
+            uint64_t overwritten = std::min(after + 1 - TRACE_BUFFER_EVENTS - begin, end - begin);
+            events.erase(events.begin() + first, events.begin() + first + overwritten);
+        }
+    }
+    buffersLock.unlock();
+
+    FILE * f = fopen(path.c_str(), "w");
+    if(f == nullptr) {
+        syslog(LOG_ERR, "Unable to open %s to dump the trace: %s", path.c_str(), strerror(errno));
+        return false;
+    }
+    pid_t pid = getpid();
+    size_t count = 0;
+    fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", f);
+    for(TraceEvent & e : events) {
+        if(e.start < since) {
+            continue;
+        }
+        //Names are DBus member names or literals, but keep the JSON valid whatever they hold
+        for(char * c = e.name; *c != '\0'; c++) {
+            if(*c == '"' || *c == '\\' || (unsigned char) *c < 0x20) {
+                *c = '_';
+            }
+        }
+        fprintf(f, "%s\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%c\",\"ts\":%llu,\"pid\":%d,\"tid\":%d", (count == 0) ? "" : ",", e.name, e.category, e.phase, (unsigned long long) e.start, (int) pid, (int) e.tid);
+        if(e.phase == 'X') {
+            fprintf(f, ",\"dur\":%llu}", (unsigned long long) e.duration);
+        }
+        else {
+            fputs(",\"s\":\"t\"}", f);
+        }
+        count++;
+    }
+    fputs("\n]}\n", f);
+    bool ok = !ferror(f);
+    fclose(f);
+    syslog(LOG_INFO, "Dumped %zu trace events from the last %.0f seconds to %s", count, seconds, path.c_str());
+    return ok;
+}